@@ -0,0 +1,36 @@
+#include "atom.hpp"
+#include <unordered_map>
+#include <vector>
+
+using std::string;
+
+namespace {
+
+struct intern_table {
+    std::unordered_map<string, unsigned> ids;
+    // Points into the keys of ids, which never move
+    std::vector<const string *> names;
+};
+
+// Built on first use so atoms can be interned during static initialization
+intern_table &table() {
+    static intern_table instance;
+    return instance;
+}
+
+} // namespace
+
+atom atom::intern(const string &name) {
+    auto &t = table();
+    auto it = t.ids.find(name);
+    if (it == t.ids.end()) {
+        it = t.ids.emplace(name, t.names.size()).first;
+        t.names.push_back(&it->first);
+    }
+
+    return atom{it->second};
+}
+
+const string &atom::name() const { return *table().names[id]; }
+
+std::ostream &operator<<(std::ostream &os, atom a) { return os << a.name(); }
@@ -0,0 +1,25 @@
+#ifndef LISPY_ATOM_HPP
+#define LISPY_ATOM_HPP
+
+#include <ostream>
+#include <string>
+
+// Interned symbol name. Every distinct name is given a small integer id the
+// first time it is seen, so comparing or hashing atoms never touches the
+// characters. Ids are never reused.
+struct atom {
+    unsigned id;
+
+    static atom intern(const std::string &name);
+
+    // Interned names live until the program exits
+    const std::string &name() const;
+
+    bool operator==(atom other) const { return id == other.id; }
+    bool operator!=(atom other) const { return id != other.id; }
+    bool operator<(atom other) const { return id < other.id; }
+};
+
+std::ostream &operator<<(std::ostream &os, atom a);
+
+#endif // LISPY_ATOM_HPP
@@ -1,16 +1,23 @@
 #include "builtin.hpp"
+#include <algorithm>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <unordered_map>
+#include <vector>
+#include "gc.hpp"
 #include "lenv.hpp"
 #include "lispy.hpp"
 #include "lval.hpp"
 #include "lval_error.hpp"
+#include "memo.hpp"
+#include "pool.hpp"
+#include "vm.hpp"
 
 using std::cout;
 using std::endl;
 using std::string;
+using std::vector;
 
 #define LVAL_OPERATOR_BASE(X, Y, E1, E2, E3, E4)                               \
     switch (X->type) {                                                         \
@@ -21,7 +28,7 @@ using std::string;
                 case lval_type::integer:                                       \
                     E2;                                                        \
                 default:                                                       \
-                    return Y;                                                  \
+                    return error(lerr::bad_num());                             \
             }                                                                  \
         case lval_type::integer:                                               \
             switch (Y->type) {                                                 \
@@ -30,33 +37,31 @@ using std::string;
                 case lval_type::integer:                                       \
                     E4;                                                        \
                 default:                                                       \
-                    return Y;                                                  \
+                    return error(lerr::bad_num());                             \
             }                                                                  \
         default:                                                               \
-            return X;                                                          \
+            return error(lerr::bad_num());                                     \
     }
 
 #define LVAL_OPERATOR(OP, X, Y)                                                \
-    LVAL_OPERATOR_BASE(X, Y, X->dec OP Y->dec; return X, X->dec OP Y->integ;   \
-                       return X, X->type = lval_type::decimal;                 \
-                       X->dec = X->integ; X->dec OP Y->dec;                    \
-                       return X, X->integ OP Y->integ; return X)
+    LVAL_OPERATOR_BASE(X, Y, return lval::make(X->dec OP Y->dec),              \
+                       return lval::make(X->dec OP Y->integ),                  \
+                       return lval::make(X->integ OP Y->dec),                  \
+                       return lval::make(X->integ OP Y->integ))
 
 #define LVAL_BINARY_HANDLER(HANDLER, X, Y)                                     \
-    LVAL_OPERATOR_BASE(X, Y, X->dec = HANDLER(X->dec, Y->dec);                 \
-                       return X, X->dec = HANDLER(X->dec, Y->integ);           \
-                       return X, X->type = lval_type::decimal;                 \
-                       X->dec = HANDLER(X->integ, Y->dec);                     \
-                       return X, X->integ = HANDLER(X->integ, Y->integ);       \
-                       return X)
+    LVAL_OPERATOR_BASE(X, Y, return lval::make(HANDLER(X->dec, Y->dec)),       \
+                       return lval::make(HANDLER(X->dec, Y->integ)),           \
+                       return lval::make(HANDLER(X->integ, Y->dec)),           \
+                       return lval::make((long)HANDLER(X->integ, Y->integ)))
 
 #define LVAL_COMPARISON(OP, X, Y, A, B)                                        \
     comp = [X, Y]() {                                                          \
         auto a = X->A;                                                         \
         auto b = Y->B;                                                         \
-        delete X;                                                              \
-        delete Y;                                                              \
-        return new lval(a OP b);                                               \
+        lval::release(X);                                                      \
+        lval::release(Y);                                                      \
+        return lval::make(a OP b);                                             \
     };                                                                         \
                                                                                \
     return comp();
@@ -71,7 +76,7 @@ using std::string;
 #define LASSERT(args, cond, err)                                               \
     if (!(cond)) {                                                             \
         auto msg = error(err);                                                 \
-        delete args;                                                           \
+        lval::release(args);                                                   \
         return msg;                                                            \
     }
 
@@ -108,6 +113,10 @@ using std::unordered_map;
 
 auto error = lval::error;
 
+const atom lambda_sym = atom::intern("\\");
+const atom macro_sym = atom::intern("\\!");
+const atom variadic_sym = atom::intern("&");
+
 unordered_map<string, function<lval *(lval *, lval *)>> operator_table = {
     {"+", add},      {"-", substract}, {"*", multiply},  {"/", divide},
     {"%", reminder}, {"^", power},     {"min", minimum}, {"max", maximum}};
@@ -138,6 +147,12 @@ void add_builtins(lenv *e) {
     e->add_builtin_function("<=", ordering_op("<="));
     e->add_builtin_function("if", if_);
 
+    // Control functions
+    e->add_builtin_function("do", do_);
+    e->add_builtin_function("let", let);
+    e->add_builtin_function("select", select);
+    e->add_builtin_function("case", case_);
+
     // List Functions
     e->add_builtin_function("head", head);
     e->add_builtin_function("tail", tail);
@@ -155,18 +170,22 @@ void add_builtins(lenv *e) {
     e->add_builtin_function("read", read);
     e->add_builtin_function("show", show);
 
+    // Memoization
+    e->add_builtin_function("memo", memo);
+    e->add_builtin_function("memo-stats", memo_stats);
+
     // Atoms
-    lval *True = new lval(true);
-    lval *False = new lval(false);
-    e->def("true", True);
-    e->def("false", False);
-    delete True;
-    delete False;
+    e->def(atom::intern("true"), lval::make(true));
+    e->def(atom::intern("false"), lval::make(false));
+
+    vm::bind_intrinsics(e);
 }
 
 void add_builtin_commands(lenv *e) {
     e->add_builtin_command(".clear", repl::clear);
     e->add_builtin_command(".printenv", repl::print_env);
+    e->add_builtin_command(".memstats", repl::mem_stats);
+    e->add_builtin_command(".gc", repl::collect);
     e->add_builtin_command(".quit", repl::quit);
 }
 
@@ -175,6 +194,13 @@ lbuiltin ope(const string &op) {
     return std::bind(handle_op, _1, _2, op);
 }
 
+// Operators leave their operands untouched and return either x or a new
+// value, so the shared immortal numbers are never modified
+lval *replace(lval *x, lval *result) {
+    if (result != x) lval::release(x);
+    return result;
+}
+
 lval *handle_op(lenv *e, lval *a, const string &op) {
     for (auto cell: a->cells) {
         LASSERT_NUMBER(op, a, cell)
@@ -182,7 +208,7 @@ lval *handle_op(lenv *e, lval *a, const string &op) {
 
     auto x = a->pop_first();
     if (op == "-" && a->cells.empty()) {
-        x = negate(x);
+        x = replace(x, negate(x));
     }
 
     auto op_it = operator_table.find(op);
@@ -190,67 +216,41 @@ lval *handle_op(lenv *e, lval *a, const string &op) {
 
     while (!a->cells.empty()) {
         auto y = a->pop_first();
-        x = handler(x, y);
-        delete y;
+        x = replace(x, handler(x, y));
+        lval::release(y);
 
         if (x->type == lval_type::error) break;
     }
 
-    delete a;
+    lval::release(a);
     return x;
 }
 
-lval *add(lval *x, lval *y){LVAL_OPERATOR(+=, x, y)}
+lval *add(lval *x, lval *y){LVAL_OPERATOR(+, x, y)}
 
-lval *substract(lval *x, lval *y){LVAL_OPERATOR(-=, x, y)}
+lval *substract(lval *x, lval *y){LVAL_OPERATOR(-, x, y)}
 
-lval *multiply(lval *x, lval *y){LVAL_OPERATOR(*=, x, y)}
+lval *multiply(lval *x, lval *y){LVAL_OPERATOR(*, x, y)}
 
-lval *err_div_zero(lval *x) {
-    delete x;
-    return error(lerr::div_zero());
-}
+lval *err_div_zero() { return error(lerr::div_zero()); }
 
-lval *err_int_mod(lval *x) {
-    delete x;
-    return error(lerr::int_mod());
-}
+lval *err_int_mod() { return error(lerr::int_mod()); }
 
 lval *divide(lval *x, lval *y) {
-    auto e1 = [x, y]() {
-        x->dec /= y->dec;
-        return x;
-    };
-    auto e2 = [x, y]() {
-        x->dec /= y->integ;
-        return x;
-    };
-    auto e3 = [x, y]() {
-        x->type = lval_type::decimal;
-        x->dec = x->integ;
-        x->dec /= y->dec;
-        return x;
-    };
-    auto e4 = [x, y]() {
-        x->integ /= y->integ;
-        return x;
-    };
-
-    LVAL_OPERATOR_BASE(x, y, return y->dec == 0 ? err_div_zero(x) : e1(),
-                       return y->integ == 0 ? err_div_zero(x) : e2(),
-                       return y->dec == 0 ? err_div_zero(x) : e3(),
-                       return y->integ == 0 ? err_div_zero(x) : e4())
+    LVAL_OPERATOR_BASE(
+        x, y,
+        return y->dec == 0 ? err_div_zero() : lval::make(x->dec / y->dec),
+        return y->integ == 0 ? err_div_zero() : lval::make(x->dec / y->integ),
+        return y->dec == 0 ? err_div_zero() : lval::make(x->integ / y->dec),
+        return y->integ == 0 ? err_div_zero()
+                             : lval::make(x->integ / y->integ))
 }
 
 lval *reminder(lval *x, lval *y) {
-    auto e4 = [x, y]() {
-        x->integ %= y->integ;
-        return x;
-    };
-
-    LVAL_OPERATOR_BASE(x, y, return err_int_mod(x), return err_int_mod(x),
-                       return err_int_mod(x),
-                       return y->integ == 0 ? err_div_zero(x) : e4())
+    LVAL_OPERATOR_BASE(x, y, return err_int_mod(), return err_int_mod(),
+                       return err_int_mod(),
+                       return y->integ == 0 ? err_div_zero()
+                                            : lval::make(x->integ % y->integ))
 }
 
 lval *power(lval *x, lval *y){LVAL_BINARY_HANDLER(pow, x, y)}
@@ -258,39 +258,20 @@ lval *power(lval *x, lval *y){LVAL_BINARY_HANDLER(pow, x, y)}
 lval *negate(lval *x) {
     switch (x->type) {
         case lval_type::decimal:
-            x->dec *= -1;
-            return x;
+            return lval::make(-x->dec);
         case lval_type::integer:
-            x->integ *= -1;
-            return x;
+            return lval::make(-x->integ);
         default:
             return x;
     }
 }
 
 lval *min_max(std::function<bool(double, double)> comp, lval *x, lval *y) {
-    auto e1 = [x, y]() {
-        x->dec = y->dec;
-        return x;
-    };
-    auto e2 = [x, y]() {
-        x->dec = y->integ;
-        return x;
-    };
-    auto e3 = [x, y]() {
-        x->type = lval_type::decimal;
-        x->dec = y->dec;
-        return x;
-    };
-    auto e4 = [x, y]() {
-        x->integ = y->integ;
-        return x;
-    };
-
-    LVAL_OPERATOR_BASE(x, y, return comp(x->dec, y->dec) ? x : e1(),
-                       return comp(x->dec, y->integ) ? x : e2(),
-                       return comp(x->integ, y->dec) ? x : e3(),
-                       return comp(x->integ, y->integ) ? x : e4())
+    LVAL_OPERATOR_BASE(
+        x, y, return comp(x->dec, y->dec) ? x : lval::make(y->dec),
+        return comp(x->dec, y->integ) ? x : lval::make((double)y->integ),
+        return comp(x->integ, y->dec) ? x : lval::make(y->dec),
+        return comp(x->integ, y->integ) ? x : lval::make(y->integ))
 }
 
 lval *minimum(lval *x, lval *y) {
@@ -316,7 +297,7 @@ lval *ord(lenv *e, lval *a, const std::string &op) {
 
     auto x = a->pop_first();
     auto y = a->pop_first();
-    delete a;
+    lval::release(a);
 
     if (op == "==") {
         LVAL_COMP_OPERATOR(==, x, y)
@@ -348,9 +329,9 @@ lval *cmp(lenv *e, lval *a, const std::string &op) {
         result = *x == *y;
     else if (op == "!=")
         result = *x != *y;
-    delete a;
+    lval::release(a);
 
-    return new lval(result);
+    return lval::make(result);
 }
 
 lval *equals(lenv *e, lval *a) { return cmp(e, a, "=="); }
@@ -369,18 +350,102 @@ lval *if_(lenv *e, lval *a) {
 
     auto cond = a->pop_first();
     bool boolean = cond->boolean;
-    delete cond;
+    lval::release(cond);
     auto result = lval::take(a, boolean ? 0 : 1);
     return lval::eval_qexpr(e, result);
 }
 
+lval *do_(lenv *e, lval *a) {
+    if (a->cells.empty()) {
+        lval::release(a);
+        return lval::qexpr();
+    }
+
+    return lval::take(a, a->cells.size() - 1);
+}
+
+lval *let(lenv *e, lval *a) {
+    LASSERT_NUM_ARGS("let", a, 1)
+    LASSERT_TYPE("let", a, a->cells.front(), lval_type::qexpr)
+
+    // Whatever the body binds with = stays in a frame of its own
+    auto frame = lenv::frame();
+    frame->parent = e;
+    auto result = lval::eval_qexpr(frame, lval::take_first(a));
+    lenv::release(frame);
+    return result;
+}
+
+// Whether v is a clause of select or case, a condition or a key followed by
+// the expression it leads to
+bool is_clause(const lval *v) {
+    return v->type == lval_type::qexpr && v->cells.size() == 2;
+}
+
+lval *select(lenv *e, lval *a) {
+    const auto &cells = a->cells;
+    for (auto clause: cells) {
+        LASSERT(a, is_clause(clause), lerr::passed_invalid_clause("select"))
+    }
+
+    // Only the conditions up to the first one that holds are evaluated
+    for (auto clause: cells) {
+        auto cond = lval::evaluate(e, clause->cells.front());
+        if (cond->type == lval_type::error) {
+            lval::release(a);
+            return cond;
+        }
+
+        LASSERT(a, cond->type == lval_type::boolean,
+                lerr::passed_incorrect_type("select", cond->type,
+                                            lval_type::boolean))
+
+        bool holds = cond->boolean;
+        lval::release(cond);
+        if (holds) {
+            auto result = lval::evaluate(e, clause->cells[1]);
+            lval::release(a);
+            return result;
+        }
+    }
+
+    lval::release(a);
+    return error(lerr::no_selection_found());
+}
+
+lval *case_(lenv *e, lval *a) {
+    const auto &cells = a->cells;
+    LASSERT(a, !cells.empty(), lerr::mismatched_num_args("case", 0, 1))
+    for (auto it = cells.begin() + 1; it != cells.end(); ++it) {
+        LASSERT(a, is_clause(*it), lerr::passed_invalid_clause("case"))
+    }
+
+    auto x = cells.front();
+    for (auto it = cells.begin() + 1; it != cells.end(); ++it) {
+        auto key = lval::evaluate(e, (*it)->cells.front());
+        if (key->type == lval_type::error) {
+            lval::release(a);
+            return key;
+        }
+
+        bool matches = *x == *key;
+        lval::release(key);
+        if (matches) {
+            auto result = lval::evaluate(e, (*it)->cells[1]);
+            lval::release(a);
+            return result;
+        }
+    }
+
+    lval::release(a);
+    return error(lerr::no_case_found());
+}
+
 lval *qexpr_head(lval *a, lval::iter begin) {
     LASSERT_NOT_EMPTY("head", a, *begin)
 
-    auto v = lval::take(a, begin);
-    while (v->cells.size() > 1) {
-        delete v->pop(1);
-    }
+    auto v = lval::unshare(lval::take(a, begin));
+    v->cells.truncate(1);
 
     return v;
 }
@@ -388,7 +453,7 @@ lval *qexpr_head(lval *a, lval::iter begin) {
 lval *string_head(lval *a, lval::iter begin) {
     LASSERT_NOT_EMPTY_STRING("head", a, *begin)
 
-    auto v = lval::take(a, begin);
+    auto v = lval::unshare(lval::take(a, begin));
     v->str = v->str.substr(0, 1);
 
     return v;
@@ -410,15 +475,15 @@ lval *head(lenv *e, lval *a) {
 lval *qexpr_tail(lval *a, lval::iter begin) {
     LASSERT_NOT_EMPTY("tail", a, *begin)
 
-    auto v = lval::take(a, begin);
-    delete v->pop_first();
+    auto v = lval::unshare(lval::take(a, begin));
+    lval::release(v->pop_first());
     return v;
 }
 
 lval *string_tail(lval *a, lval::iter begin) {
     LASSERT_NOT_EMPTY_STRING("tail", a, *begin)
 
-    auto v = lval::take(a, begin);
+    auto v = lval::unshare(lval::take(a, begin));
     v->str = v->str.substr(1);
 
     return v;
@@ -453,16 +518,19 @@ lval *eval(lenv *e, lval *a) {
 }
 
 lval *qexpr_join(lval *a) {
-    auto x = a->pop_first();
+    auto x = lval::unshare(a->pop_first());
     for (auto expr: a->cells) {
-        x->cells.splice(x->cells.end(), expr->cells);
+        const auto &cells = expr->cells;
+        for (auto cell: cells) {
+            x->cells.push_back(lval::copy(cell));
+        }
     }
 
     return x;
 }
 
 lval *string_join(lval *a) {
-    auto x = a->pop_first();
+    auto x = lval::unshare(a->pop_first());
     for (auto expr: a->cells) {
         x->str += expr->str;
     }
@@ -485,20 +553,20 @@ lval *join(lenv *e, lval *a) {
     else
         x = string_join(a);
 
-    delete a;
+    lval::release(a);
     return x;
 }
 
 lval *cons(lenv *e, lval *a) {
     LASSERT_NUM_ARGS("cons", a, 2)
-    auto it = ++a->cells.begin();
+    auto it = a->cells.begin() + 1;
 
     LASSERT_TYPE("cons", a, *it, lval_type::qexpr)
 
     auto x = a->pop_first();
-    auto v = a->pop_first();
+    auto v = lval::unshare(a->pop_first());
     v->cells.push_front(x);
-    delete a;
+    lval::release(a);
 
     return v;
 }
@@ -510,9 +578,9 @@ lval *len(lenv *e, lval *a) {
     LASSERT_TYPE2("len", a, *begin, lval_type::qexpr, lval_type::string)
 
     auto x = lval::take(a, begin);
-    auto length = new lval(x->type == lval_type::qexpr ? (long)x->cells.size()
-                                                       : (long)x->str.size());
-    delete x;
+    auto length = lval::make(x->type == lval_type::qexpr ? (long)x->cells.size()
+                                                         : (long)x->str.size());
+    lval::release(x);
     return length;
 }
 
@@ -523,10 +591,8 @@ lval *init(lenv *e, lval *a) {
     LASSERT_TYPE("init", a, *begin, lval_type::qexpr)
     LASSERT(a, (*begin)->cells.size() != 0, lerr::passed_nil_expr("init"))
 
-    auto v = lval::take(a, begin);
-    auto end = v->cells.end();
-    end--;
-    delete v->pop(end);
+    auto v = lval::unshare(lval::take(a, begin));
+    lval::release(v->cells.pop_back());
     return v;
 }
 
@@ -559,7 +625,7 @@ lval *var(lenv *e, lval *a, const string &func) {
     a = lval::eval_cells(e, a);
 
     if (a->type == lval_type::error) {
-        delete syms;
+        lval::release(syms);
         return a;
     }
 
@@ -567,14 +633,14 @@ lval *var(lenv *e, lval *a, const string &func) {
     for (auto sym_it = syms->cells.begin(); sym_it != syms->cells.end();
          ++sym_it, ++val_it) {
         if (func == "def") {
-            e->def((*sym_it)->sym, *val_it);
+            e->def((*sym_it)->sym.name, *val_it);
         } else if (func == "=") {
-            e->put((*sym_it)->sym, *val_it);
+            e->put((*sym_it)->sym.name, *val_it);
         }
     }
 
-    delete a;
-    delete syms;
+    lval::release(a);
+    lval::release(syms);
     return lval::sexpr();
 }
 
@@ -582,6 +648,112 @@ lval *def(lenv *e, lval *a) { return var(e, a, "def"); }
 
 lval *put(lenv *e, lval *a) { return var(e, a, "="); }
 
+// Whether expr has the shape (\\ {formals} {body}) or (\\! {formals} {body})
+bool is_lambda_form(const lval *expr) {
+    const auto &cells = expr->cells;
+    if (cells.size() != 3 || cells[0]->type != lval_type::symbol) return false;
+
+    auto name = cells[0]->sym.name;
+    return (name == lambda_sym || name == macro_sym) &&
+           cells[1]->type == lval_type::qexpr &&
+           cells[2]->type == lval_type::qexpr;
+}
+
+// Depth and slot of the parameter symbol sym names among scopes, or
+// unresolved
+std::pair<unsigned short, unsigned short> resolution(
+    const lval *sym, const vector<const lval *> &scopes) {
+    for (size_t depth = 0; depth < scopes.size(); depth++) {
+        unsigned short slot = 0;
+        for (auto formal: scopes[depth]->cells) {
+            if (formal->sym.name == variadic_sym) continue;
+            if (formal->sym.name == sym->sym.name) return {depth, slot};
+
+            slot++;
+        }
+    }
+
+    return {0, lval::unresolved};
+}
+
+bool is_resolved(const lval *sym, const vector<const lval *> &scopes) {
+    auto found = resolution(sym, scopes);
+    return sym->sym.depth == found.first && sym->sym.slot == found.second;
+}
+
+// Range of the cells of expr resolved in scopes, which holds the formals of
+// expr itself first if it is a lambda form
+std::pair<size_t, size_t> resolved_cells(const lval *expr,
+                                         vector<const lval *> &scopes) {
+    if (!is_lambda_form(expr)) return {0, expr->cells.size()};
+
+    scopes.insert(scopes.begin(), expr->cells[1]);
+    return {2, 3};
+}
+
+// Whether resolving expr in scopes would leave it as it is
+bool is_resolved_expr(const lval *expr, vector<const lval *> &scopes) {
+    auto range = resolved_cells(expr, scopes);
+    bool resolved = true;
+    for (auto i = range.first; i < range.second && resolved; i++) {
+        auto cell = expr->cells[i];
+        switch (cell->type) {
+            case lval_type::symbol:
+                resolved = is_resolved(cell, scopes);
+                break;
+            case lval_type::sexpr:
+            case lval_type::qexpr:
+                resolved = is_resolved_expr(cell, scopes);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (range.first == 2) scopes.erase(scopes.begin());
+    return resolved;
+}
+
+// Resolves the symbols in expr naming a parameter of one of the functions
+// it is nested in, taking expr over. scopes holds their formals, innermost
+// first. Bodies may be shared, like a quoted body several lambdas are made
+// of, so the nodes that change are copied when anything else holds them
+lval *resolve(lval *expr, vector<const lval *> &scopes) {
+    if (expr->is_shared()) {
+        if (is_resolved_expr(expr, scopes)) return expr;
+        expr = lval::unshare(expr);
+    }
+
+    auto range = resolved_cells(expr, scopes);
+    for (auto i = range.first; i < range.second; i++) {
+        auto &cell = expr->cells.begin()[i];
+        switch (cell->type) {
+            case lval_type::symbol:
+                if (!is_resolved(cell, scopes)) {
+                    auto found = resolution(cell, scopes);
+                    cell = lval::unshare(cell);
+                    cell->sym.depth = found.first;
+                    cell->sym.slot = found.second;
+                }
+                break;
+            case lval_type::sexpr:
+            case lval_type::qexpr:
+                cell = resolve(cell, scopes);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (range.first == 2) scopes.erase(scopes.begin());
+    return expr;
+}
+
+lval *resolve(lval *body, const lval *formals) {
+    vector<const lval *> scopes = {formals};
+    return resolve(body, scopes);
+}
+
 lval *lambda(lenv *e, lval *a, const string &func) {
     LASSERT_NUM_ARGS(func, a, 2)
     auto begin = a->cells.begin();
@@ -598,12 +770,14 @@ lval *lambda(lenv *e, lval *a, const string &func) {
 
     auto formals = a->pop_first();
     auto body = a->pop_first();
-    delete a;
+    lval::release(a);
 
-    if (func == "\\")
-        return lval::function(formals, body);
-    else
-        return lval::macro(formals, body);
+    body = resolve(body, formals);
+
+    auto v = func == "\\" ? lval::function(formals, body)
+                          : lval::macro(formals, body);
+    v->lambda.code = vm::compile(body);
+    return v;
 }
 
 lval *func_lambda(lenv *e, lval *a) { return lambda(e, a, "\\"); }
@@ -627,11 +801,12 @@ lval *load(lenv *e, lval *a) {
                 cout << *x << endl;
             }
 
-            delete x;
+            lval::release(x);
+            gc::safe_point({expr, a});
         }
 
-        delete expr;
-        delete a;
+        lval::release(expr);
+        lval::release(a);
 
         return lval::sexpr();
     } else {
@@ -640,7 +815,7 @@ lval *load(lenv *e, lval *a) {
 
         auto err = error(lerr::could_not_load_library(err_msg));
         free(err_msg);
-        delete a;
+        lval::release(a);
 
         return err;
     }
@@ -652,7 +827,7 @@ lval *print(lenv *e, lval *a) {
     }
 
     cout << endl;
-    delete a;
+    lval::release(a);
 
     return lval::sexpr();
 }
@@ -665,7 +840,7 @@ lval *make_error(lenv *e, lval *a) {
 
     lval *err = error((*begin)->str);
 
-    delete a;
+    lval::release(a);
     return err;
 }
 
@@ -684,7 +859,7 @@ lval *read_file(lenv *e, lval *a, const string &filename) {
         result->type = lval_type::qexpr;
 
         mpc_ast_delete((mpc_ast_t *)r.output);
-        delete a;
+        lval::release(a);
 
         return result;
     } else {
@@ -693,7 +868,7 @@ lval *read_file(lenv *e, lval *a, const string &filename) {
 
         auto err = error(lerr::could_not_load_library(err_msg));
         free(err_msg);
-        delete a;
+        lval::release(a);
 
         return err;
     }
@@ -713,11 +888,44 @@ lval *show(lenv *e, lval *a) {
         }
     }
 
-    delete a;
+    lval::release(a);
 
     return lval::sexpr();
 }
 
+lval *memo(lenv *e, lval *a) {
+    LASSERT(a, a->cells.size() == 1 || a->cells.size() == 2,
+            lerr::mismatched_num_args("memo", a->cells.size(), 1))
+    auto begin = a->cells.begin();
+
+    LASSERT_TYPE("memo", a, *begin, lval_type::func)
+
+    size_t capacity = memo::default_capacity;
+    if (a->cells.size() == 2) {
+        auto size = a->cells[1];
+        LASSERT_TYPE("memo", a, size, lval_type::integer)
+        LASSERT(a, size->integ > 0, lerr::passed_non_positive("memo"))
+        capacity = size->integ;
+    }
+
+    auto v = lval::function(memo::make(*begin, capacity));
+    lval::release(a);
+    return v;
+}
+
+lval *memo_stats(lenv *e, lval *a) {
+    LASSERT_NUM_ARGS("memo-stats", a, 1)
+
+    auto stats = memo::stats(a->cells.front());
+    LASSERT(a, stats, lerr::passed_non_memoized("memo-stats"))
+
+    auto v = lval::qexpr({lval::make((long)stats->hits),
+                          lval::make((long)stats->misses),
+                          lval::make((long)stats->entries)});
+    lval::release(a);
+    return v;
+}
+
 namespace repl {
 
 lval *clear(lenv *e, lval *a) {
@@ -731,13 +939,31 @@ lval *clear(lenv *e, lval *a) {
 
 lval *print_env(lenv *e, lval *a) {
     LASSERT_NUM_ARGS("printenv", a, 0)
-    for (auto entry: e->symbols) {
-        cout << entry.first << ": " << *entry.second << "\n";
+    for (auto &name: e->keys()) {
+        cout << name << ": " << *e->lookup(atom::intern(name)) << "\n";
     }
 
     cout << std::endl;
 
-    delete a;
+    lval::release(a);
+    return lval::sexpr();
+}
+
+lval *mem_stats(lenv *e, lval *a) {
+    LASSERT_NUM_ARGS("memstats", a, 0)
+    cout << pool::stats() << '\n' << gc::stats() << endl;
+
+    lval::release(a);
+    return lval::sexpr();
+}
+
+lval *collect(lenv *e, lval *a) {
+    LASSERT_NUM_ARGS("gc", a, 0)
+
+    auto lspy = lispy::instance();
+    lspy->flags |= LISPY_FLAG_COLLECT;
+
+    lval::release(a);
     return lval::sexpr();
 }
 
@@ -20,6 +20,10 @@ lval *put(lenv *env, lval *args);
 lval *func_lambda(lenv *env, lval *args);
 lval *macro_lambda(lenv *env, lval *args);
 
+// Resolves the symbols in body naming one of formals, see lval::symbol_type.
+// Takes body over and returns it, or a copy of it if it was shared
+lval *resolve(lval *body, const lval *formals);
+
 // Operators
 lbuiltin ope(const std::string &op);
 lval *handle_op(lenv *env, lval *args, const std::string &op);
@@ -43,6 +47,12 @@ lval *equals(lenv *env, lval *args);
 lval *not_equals(lenv *env, lval *args);
 lval *if_(lenv *env, lval *args);
 
+// Control functions
+lval *do_(lenv *env, lval *args);
+lval *let(lenv *env, lval *args);
+lval *select(lenv *env, lval *args);
+lval *case_(lenv *env, lval *args);
+
 // List functions
 lval *head(lenv *env, lval *args);
 lval *tail(lenv *env, lval *args);
@@ -61,10 +71,16 @@ lval *read(lenv *env, lval *args);
 lval *read_file(lenv *env, lval *args, const std::string &filename);
 lval *show(lenv *env, lval *args);
 
+// Memoization
+lval *memo(lenv *env, lval *args);
+lval *memo_stats(lenv *env, lval *args);
+
 // REPL commands
 namespace repl {
 lval *clear(lenv *env, lval *args);
 lval *print_env(lenv *env, lval *args);
+lval *mem_stats(lenv *env, lval *args);
+lval *collect(lenv *env, lval *args);
 lval *quit(lenv *env, lval *args);
 } // namespace repl
 } // namespace builtin
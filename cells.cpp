@@ -0,0 +1,274 @@
+#include "cells.hpp"
+#include <algorithm>
+#include <cstring>
+#include "lval.hpp"
+#include "pool.hpp"
+
+const size_t cell_list::inline_size;
+
+cell_list::cell_list(): buf(nullptr), first(0), count(0) {}
+
+cell_list::cell_list(const cell_list &other): cell_list() { *this = other; }
+
+cell_list::cell_list(std::initializer_list<lval *> cells): cell_list() {
+    *this = cells;
+}
+
+cell_list::~cell_list() { clear(); }
+
+cell_list &cell_list::operator=(const cell_list &other) {
+    if (this == &other) return *this;
+
+    clear();
+    if (other.buf) {
+        buf = other.buf;
+        buf->refs++;
+        first = other.first;
+        count = other.count;
+    } else {
+        for (auto v: other) {
+            inline_cells[count++] = lval::copy(v);
+        }
+    }
+
+    return *this;
+}
+
+cell_list &cell_list::operator=(std::initializer_list<lval *> cells) {
+    clear();
+    for (auto v: cells) {
+        push_back(v);
+    }
+
+    return *this;
+}
+
+cell_list::iterator cell_list::begin() {
+    detach();
+    return data() + first;
+}
+
+cell_list::iterator cell_list::end() {
+    detach();
+    return data() + first + count;
+}
+
+void cell_list::clear() {
+    if (buf) {
+        release(buf);
+        buf = nullptr;
+    } else {
+        for (auto i = first; i < first + count; i++) {
+            lval::release(inline_cells[i]);
+        }
+    }
+
+    first = 0;
+    count = 0;
+}
+
+void cell_list::push_back(lval *v) {
+    if (!buf) {
+        if (first + count < inline_size) {
+            inline_cells[first + count++] = v;
+            return;
+        }
+
+        if (count < inline_size) {
+            std::memmove(inline_cells, inline_cells + first,
+                         count * sizeof(lval *));
+            first = 0;
+            inline_cells[count++] = v;
+            return;
+        }
+
+        relocate(0, count);
+    } else if (exclusive()) {
+        trim();
+        if (buf->high == buf->capacity) {
+            relocate(0, std::max<size_t>(count, inline_size));
+        }
+    } else if (first + count != buf->high || buf->high == buf->capacity) {
+        // The slot after the slice is taken by another list
+        relocate(0, std::max<size_t>(count, inline_size));
+    }
+
+    buf->items()[buf->high++] = v;
+    count++;
+}
+
+void cell_list::push_front(lval *v) {
+    if (!buf) {
+        if (first == 0 && count < inline_size) {
+            auto gap = inline_size - count;
+            std::memmove(inline_cells + gap, inline_cells,
+                         count * sizeof(lval *));
+            first = gap;
+        }
+
+        if (first > 0) {
+            inline_cells[--first] = v;
+            count++;
+            return;
+        }
+
+        relocate(count, 0);
+    } else if (exclusive()) {
+        trim();
+        if (buf->low == 0) relocate(std::max<size_t>(count, inline_size), 0);
+    } else if (first != buf->low || buf->low == 0) {
+        // The slot before the slice is taken by another list
+        relocate(std::max<size_t>(count, inline_size), 0);
+    }
+
+    buf->items()[--buf->low] = v;
+    first--;
+    count++;
+}
+
+lval *cell_list::pop_front() {
+    lval *v;
+    if (!buf) {
+        v = inline_cells[first];
+    } else if (exclusive()) {
+        trim();
+        v = buf->items()[buf->low++];
+    } else {
+        v = lval::copy(buf->items()[first]);
+    }
+
+    first++;
+    if (--count == 0) clear();
+    return v;
+}
+
+lval *cell_list::pop_back() {
+    lval *v;
+    if (!buf) {
+        v = inline_cells[first + count - 1];
+    } else if (exclusive()) {
+        trim();
+        v = buf->items()[--buf->high];
+    } else {
+        v = lval::copy(buf->items()[first + count - 1]);
+    }
+
+    if (--count == 0) clear();
+    return v;
+}
+
+lval *cell_list::pop(iterator pos) {
+    size_t index = pos - (data() + first);
+    if (index == 0) return pop_front();
+    if (index == count - 1) return pop_back();
+
+    detach();
+    auto cells = data() + first;
+    auto v = cells[index];
+    std::memmove(cells + index, cells + index + 1,
+                 (count - index - 1) * sizeof(lval *));
+    count--;
+    if (buf) buf->high--;
+
+    return v;
+}
+
+void cell_list::truncate(size_t n) {
+    if (n >= count) return;
+
+    if (exclusive()) {
+        if (buf) trim();
+
+        auto cells = data() + first;
+        for (auto i = n; i < count; i++) {
+            lval::release(cells[i]);
+        }
+
+        if (buf) buf->high = first + n;
+    }
+
+    count = n;
+    if (count == 0) clear();
+}
+
+cell_list::buffer *cell_list::allocate(size_t capacity) {
+    auto size = sizeof(buffer) + capacity * sizeof(lval *);
+    auto b = static_cast<buffer *>(pool::allocate(size));
+    b->refs = 1;
+    b->capacity = capacity;
+    b->low = 0;
+    b->high = 0;
+    return b;
+}
+
+void cell_list::release(buffer *b) {
+    if (--b->refs > 0) return;
+
+    auto items = b->items();
+    for (auto i = b->low; i < b->high; i++) {
+        lval::release(items[i]);
+    }
+
+    pool::deallocate(b, sizeof(buffer) + b->capacity * sizeof(lval *));
+}
+
+void cell_list::trim() {
+    auto items = buf->items();
+    for (auto i = buf->low; i < first; i++) {
+        lval::release(items[i]);
+    }
+
+    for (auto i = first + count; i < buf->high; i++) {
+        lval::release(items[i]);
+    }
+
+    buf->low = first;
+    buf->high = first + count;
+}
+
+void cell_list::detach() {
+    if (!buf) return;
+
+    if (buf->refs == 1) {
+        trim();
+    } else if (count <= inline_size) {
+        auto items = buf->items() + first;
+        buf->refs--;
+        buf = nullptr;
+
+        for (unsigned i = 0; i < count; i++) {
+            inline_cells[i] = lval::copy(items[i]);
+        }
+
+        first = 0;
+    } else {
+        relocate(0, 0);
+    }
+}
+
+void cell_list::relocate(size_t front, size_t back) {
+    auto b = allocate(front + count + back);
+    auto items = b->items() + front;
+
+    if (exclusive()) {
+        if (buf) trim();
+        std::memcpy(items, data() + first, count * sizeof(lval *));
+        if (buf) {
+            // The values were moved, so the old buffer must not release them
+            buf->low = buf->high;
+            release(buf);
+        }
+    } else {
+        auto cells = data() + first;
+        for (unsigned i = 0; i < count; i++) {
+            items[i] = lval::copy(cells[i]);
+        }
+
+        buf->refs--;
+    }
+
+    buf = b;
+    first = front;
+    b->low = front;
+    b->high = front + count;
+}
@@ -0,0 +1,101 @@
+#ifndef LISPY_CELLS_HPP
+#define LISPY_CELLS_HPP
+
+#include <cstddef>
+#include <initializer_list>
+
+struct lval;
+
+// Persistent sequence of values holding the cells of S/Q-expressions.
+//
+// Up to inline_size cells are stored in the object itself. Longer sequences
+// live in a reference counted buffer that copies share, each copy seeing its
+// own slice of it. Taking the tail or the head of a list is therefore O(1)
+// and leaves the original untouched, and cons on a list that starts at the
+// front of its buffer reuses the free slot before it without copying.
+//
+// The list owns one reference to every value in it. Values pushed in are
+// taken over and values popped out are handed back to the caller, who then
+// owns them. Non-const access to the elements first gives the list a
+// private copy of the buffer if it is shared, so writing through it never
+// shows up in other lists.
+class cell_list {
+   public:
+    static const size_t inline_size = 4;
+
+    using value_type = lval *;
+    using iterator = lval **;
+    using const_iterator = lval *const *;
+
+    cell_list();
+    cell_list(const cell_list &other);
+    cell_list(std::initializer_list<lval *> cells);
+    ~cell_list();
+
+    cell_list &operator=(const cell_list &other);
+    cell_list &operator=(std::initializer_list<lval *> cells);
+
+    const_iterator begin() const { return data() + first; }
+    const_iterator end() const { return data() + first + count; }
+    iterator begin();
+    iterator end();
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    lval *operator[](size_t i) const { return data()[first + i]; }
+    lval *front() const { return data()[first]; }
+    lval *back() const { return data()[first + count - 1]; }
+
+    // Releases every value
+    void clear();
+
+    void push_back(lval *v);
+    void push_front(lval *v);
+
+    lval *pop_front();
+    lval *pop_back();
+    lval *pop(iterator pos);
+
+    // Keeps the first n values, releasing the rest
+    void truncate(size_t n);
+
+   private:
+    struct buffer {
+        unsigned refs;
+        unsigned capacity;
+        // Range of slots holding a value owned by the buffer. It covers the
+        // slices of every list sharing the buffer
+        unsigned low;
+        unsigned high;
+
+        lval **items() { return reinterpret_cast<lval **>(this + 1); }
+    };
+
+    // Null while the values fit in inline_cells
+    buffer *buf;
+    // Slice of data() holding the values
+    unsigned first;
+    unsigned count;
+    lval *inline_cells[inline_size];
+
+    lval **data() { return buf ? buf->items() : inline_cells; }
+    lval *const *data() const { return buf ? buf->items() : inline_cells; }
+
+    bool exclusive() const { return !buf || buf->refs == 1; }
+
+    static buffer *allocate(size_t capacity);
+    static void release(buffer *b);
+
+    // Releases the values of an exclusive buffer outside of the slice
+    void trim();
+
+    // Makes the values exclusive to this list
+    void detach();
+
+    // Moves the values to a new exclusive buffer, with front free slots
+    // before them and at least back free slots after them
+    void relocate(size_t front, size_t back);
+};
+
+#endif // LISPY_CELLS_HPP
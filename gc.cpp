@@ -0,0 +1,143 @@
+#include "gc.hpp"
+#include <algorithm>
+#include <vector>
+#include "lenv.hpp"
+#include "lval.hpp"
+#include "memo.hpp"
+#include "vm.hpp"
+
+using std::vector;
+
+namespace gc {
+
+struct collector {
+    vector<lval *> tracked;
+    vector<lenv *> roots;
+    size_t depth = 0;
+    // Containers that survived the last collection
+    size_t survivors = 0;
+    settings config = {2.0, 10000};
+    statistics stats = {0, 0, 0, 0};
+};
+
+thread_local collector local;
+
+void track(lval *v) {
+    v->gc_slot = local.tracked.size();
+    local.tracked.push_back(v);
+}
+
+void untrack(lval *v) {
+    auto &tracked = local.tracked;
+    auto last = tracked.back();
+    last->gc_slot = v->gc_slot;
+    tracked[v->gc_slot] = last;
+    tracked.pop_back();
+}
+
+void add_root(lenv *env) { local.roots.push_back(env); }
+
+void remove_root(lenv *env) {
+    auto &roots = local.roots;
+    roots.erase(std::remove(roots.begin(), roots.end(), env), roots.end());
+}
+
+eval_scope::eval_scope() { local.depth++; }
+
+eval_scope::~eval_scope() { local.depth--; }
+
+void push_env(const lenv *env, vector<lval *> &stack) {
+    if (!env) return;
+
+    for (auto &entry: env->symbols) {
+        stack.push_back(entry.value);
+    }
+}
+
+void mark(vector<lval *> &stack) {
+    while (!stack.empty()) {
+        auto v = stack.back();
+        stack.pop_back();
+        if (v->marked || !v->is_container()) continue;
+
+        v->marked = true;
+        switch (v->type) {
+            case lval_type::sexpr:
+            case lval_type::qexpr: {
+                const auto &cells = v->cells;
+                stack.insert(stack.end(), cells.begin(), cells.end());
+                break;
+            }
+            default:
+                stack.push_back(v->lambda.formals);
+                stack.push_back(v->lambda.body);
+                if (v->lambda.bound) stack.push_back(v->lambda.bound);
+                if (v->lambda.code) vm::trace(v->lambda.code, stack);
+                break;
+        }
+    }
+}
+
+size_t threshold() {
+    return std::max(local.config.min_threshold,
+                    (size_t)(local.survivors * local.config.growth_factor));
+}
+
+void safe_point(std::initializer_list<const lval *> pending) {
+    if (local.depth == 0 && local.tracked.size() >= threshold()) {
+        collect(pending);
+    }
+}
+
+size_t collect(std::initializer_list<const lval *> pending) {
+    vector<lval *> stack;
+    for (auto env: local.roots) {
+        push_env(env, stack);
+    }
+
+    for (auto v: pending) {
+        stack.push_back(const_cast<lval *>(v));
+    }
+
+    memo::trace(stack);
+
+    mark(stack);
+
+    vector<lval *> garbage;
+    for (auto v: local.tracked) {
+        if (v->marked || v->immortal) {
+            v->marked = false;
+        } else {
+            garbage.push_back(v);
+        }
+    }
+
+    // Unreachable containers only keep each other alive. Hold on to all of
+    // them while their references are dropped, so none is freed halfway
+    for (auto v: garbage) v->refs++;
+    for (auto v: garbage) v->clear();
+    for (auto v: garbage) lval::release(v);
+
+    local.survivors = local.tracked.size();
+    local.stats.collections++;
+    local.stats.freed += garbage.size();
+
+    return garbage.size();
+}
+
+settings &config() { return local.config; }
+
+const statistics &stats() {
+    local.stats.tracked = local.tracked.size();
+    local.stats.threshold = threshold();
+    return local.stats;
+}
+
+std::ostream &operator<<(std::ostream &os, const statistics &stats) {
+    return os << "Tracked containers: " << stats.tracked
+              << "\nCollection threshold: " << stats.threshold
+              << "\nCollections: " << stats.collections
+              << "\nContainers collected: " << stats.freed;
+}
+
+} // namespace gc
@@ -0,0 +1,63 @@
+#ifndef LISPY_GC_HPP
+#define LISPY_GC_HPP
+
+#include <cstddef>
+#include <initializer_list>
+#include <ostream>
+
+struct lval;
+struct lenv;
+
+// Tracing collector for reference cycles. Reference counting frees values as
+// soon as their last owner lets go, so the collector only has to find
+// containers (S/Q-expressions and lambdas) that keep each other alive.
+//
+// Collections only happen at safe points, where the evaluator holds nothing
+// but the roots: the registered environments and the pending top-level
+// expressions passed by the caller.
+namespace gc {
+
+struct statistics {
+    // Containers currently known to the collector
+    size_t tracked;
+    // Number of tracked containers that triggers the next collection
+    size_t threshold;
+    size_t collections;
+    // Containers freed by the collector since the program started
+    size_t freed;
+};
+
+struct settings {
+    // The next threshold is the survivors of a collection times this
+    double growth_factor;
+    // Threshold never drops below this
+    size_t min_threshold;
+};
+
+void track(lval *v);
+void untrack(lval *v);
+
+void add_root(lenv *env);
+void remove_root(lenv *env);
+
+// Marks the evaluator as busy while alive, disabling safe points
+struct eval_scope {
+    eval_scope();
+    ~eval_scope();
+};
+
+// Collects if the heap grew past the threshold
+void safe_point(std::initializer_list<const lval *> pending = {});
+
+// Collects unconditionally, returns the number of containers freed. Must
+// only be called where safe_point would be
+size_t collect(std::initializer_list<const lval *> pending = {});
+
+settings &config();
+const statistics &stats();
+
+std::ostream &operator<<(std::ostream &os, const statistics &stats);
+
+} // namespace gc
+
+#endif // LISPY_GC_HPP
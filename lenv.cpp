@@ -7,28 +7,73 @@ using std::string;
 using std::vector;
 auto error = lval::error;
 
+unsigned global_version = 1;
+
+// Number of non-global frames binding each atom, indexed by id
+vector<unsigned> local_bindings;
+
+void add_local_binding(atom sym) {
+    if (sym.id >= local_bindings.size()) local_bindings.resize(sym.id + 1);
+    local_bindings[sym.id]++;
+}
+
 lenv::lenv() { this->parent = nullptr; }
 
-lenv::lenv(const lenv &other): symbols(table_type(other.symbols)) {
-    this->parent = other.parent;
-    for (auto it = this->symbols.begin(); it != this->symbols.end(); ++it) {
-        it->second = new lval(it->second);
+lenv::~lenv() { clear(); }
+
+// Frames released, linked through parent. Calls come and go all the time,
+// so keeping a few around saves clearing and allocating the frame and its
+// table on every call
+const size_t max_spare_frames = 64;
+thread_local lenv *spare_frames = nullptr;
+thread_local size_t spare_count = 0;
+
+lenv *lenv::frame() {
+    if (!spare_frames) return new lenv();
+
+    auto e = spare_frames;
+    spare_frames = e->parent;
+    spare_count--;
+    e->parent = nullptr;
+    return e;
+}
+
+void lenv::release(lenv *e) {
+    if (!e) return;
+
+    if (e->global || spare_count == max_spare_frames) {
+        delete e;
+        return;
     }
+
+    e->clear();
+    e->parent = spare_frames;
+    spare_frames = e;
+    spare_count++;
 }
 
-lenv::lenv(const lenv *const other): lenv(*other) {}
+void *lenv::operator new(size_t size) { return pool::allocate(size); }
+
+void lenv::operator delete(void *ptr, size_t size) {
+    pool::deallocate(ptr, size);
+}
 
-lenv::~lenv() {
-    for (auto entry: this->symbols) {
-        delete entry.second;
+void lenv::clear() {
+    for (auto &entry: this->symbols) {
+        lval::release(entry.value);
+        if (!global) local_bindings[entry.key.id]--;
     }
+
+    if (global) global_version++;
+    symbols.clear();
 }
 
 vector<string> lenv::keys() const {
     vector<string> keys;
     keys.reserve(symbols.size());
     std::transform(symbols.begin(), symbols.end(), std::back_inserter(keys),
-                   [](auto it) { return it.first; });
+                   [](auto &entry) { return entry.key.name(); });
+    std::sort(keys.begin(), keys.end());
     return keys;
 }
 
@@ -36,41 +81,69 @@ vector<const string *> lenv::keys(const string &prefix) const {
     vector<const string *> keys;
     keys.reserve(symbols.size());
 
-    for (auto it = symbols.begin(); it != symbols.end(); ++it) {
-        auto &sym = it->first;
+    for (auto &entry: symbols) {
+        auto &sym = entry.key.name();
         if (prefix.size() <= sym.size() &&
             std::equal(prefix.begin(), prefix.end(), sym.begin())) {
             keys.push_back(&sym);
         }
     }
 
+    std::sort(keys.begin(), keys.end(),
+              [](auto a, auto b) { return *a < *b; });
     return keys;
 }
 
-lval *lenv::get(const string &sym) const {
-    auto it = symbols.find(sym);
-    if (it != symbols.end()) {
-        return new lval(it->second);
+const lval *lenv::lookup(atom sym) const {
+    for (auto e = this; e; e = e->parent) {
+        auto entry = e->symbols.find(sym);
+        if (entry) return entry->value;
     }
 
-    if (parent) {
-        return parent->get(sym);
+    return nullptr;
+}
+
+const lval *lenv::lookup(atom sym, unsigned depth, unsigned slot) const {
+    auto e = this;
+    for (; depth > 0 && e; depth--, e = e->parent) {
+        auto entry = e->symbols.find(sym);
+        if (entry) return entry->value;
     }
 
-    return error(lerr::unknown_sym(sym));
+    if (!e) return nullptr;
+
+    auto entry = e->symbols.at(slot);
+    if (entry && entry->key == sym) return entry->value;
+
+    return e->lookup(sym);
 }
 
-void lenv::put(const string &sym, const lval *const v) {
-    auto it = symbols.find(sym);
-    if (it != symbols.end()) {
-        delete it->second;
-        it->second = new lval(v);
-    } else {
-        symbols.insert(std::make_pair(sym, new lval(v)));
+unsigned lenv::version() { return global_version; }
+
+bool lenv::bound_locally(atom sym) {
+    return sym.id < local_bindings.size() && local_bindings[sym.id] > 0;
+}
+
+lval *lenv::get(atom sym) const {
+    auto v = lookup(sym);
+    return v ? lval::copy(v) : error(lerr::unknown_sym(sym.name()));
+}
+
+void lenv::put(atom sym, const lval *const v) {
+    auto inserted = symbols.insert(sym, nullptr);
+    auto entry = inserted.first;
+    if (!inserted.second) {
+        lval::release(entry->value);
+    } else if (!global) {
+        add_local_binding(sym);
     }
+
+    if (global) global_version++;
+
+    entry->value = lval::copy(v);
 }
 
-void lenv::def(const string &sym, const lval *const v) {
+void lenv::def(atom sym, const lval *const v) {
     auto e = this;
     while (e->parent) e = e->parent;
 
@@ -78,13 +151,13 @@ void lenv::def(const string &sym, const lval *const v) {
 }
 
 void lenv::add_builtin_function(const string &name, lbuiltin func) {
-    symbols.insert(std::make_pair(name, lval::function(func)));
+    symbols.insert(atom::intern(name), lval::function(func));
 }
 
 void lenv::add_builtin_macro(const string &name, lbuiltin func) {
-    symbols.insert(std::make_pair(name, lval::macro(func)));
+    symbols.insert(atom::intern(name), lval::macro(func));
 }
 
 void lenv::add_builtin_command(const string &name, lbuiltin func) {
-    symbols.insert(std::make_pair(name, lval::command(func)));
+    symbols.insert(atom::intern(name), lval::command(func));
 }
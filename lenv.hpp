@@ -1,30 +1,67 @@
 #ifndef LENV_HPP
 #define LENV_HPP
 
-#include <map>
 #include <string>
 #include <vector>
+#include "atom.hpp"
 #include "builtin.hpp"
+#include "symbol_table.hpp"
 
 struct lval;
 
 struct lenv {
-    using table_type = std::map<std::string, lval *>;
+    using table_type = symbol_table;
 
+    // Frame of the caller. Scoping is dynamic, so whatever is not bound in
+    // this frame is looked up there
     lenv *parent;
+
+    // Whether this is the top-level frame, the one def binds in
+    bool global = false;
+
     table_type symbols;
 
     lenv();
-    lenv(const lenv &other);
-    explicit lenv(const lenv *const other);
+    lenv(const lenv &other) = delete;
     ~lenv();
 
+    // New empty frame for a call, reusing one released earlier if possible
+    static lenv *frame();
+
+    // Accepts null. Released frames are kept for reuse by frame, up to a
+    // few
+    static void release(lenv *e);
+
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size);
+
+    // Drops all bindings
+    void clear();
+
     std::vector<std::string> keys() const;
     std::vector<const std::string *> keys(const std::string &prefix) const;
 
-    lval *get(const std::string &sym) const;
-    void put(const std::string &sym, const lval *const val);
-    void def(const std::string &sym, const lval *const val);
+    // Borrowed reference to the bound value, or null if it is unbound. It
+    // stays valid until the binding changes
+    const lval *lookup(atom sym) const;
+
+    // Same as lookup(sym), given that sym was resolved to the slot of the
+    // frame depth levels up. That is only a guess, scoping being dynamic,
+    // but when it holds the search is skipped
+    const lval *lookup(atom sym, unsigned depth, unsigned slot) const;
+
+    // Changes whenever a binding in a global frame does, so a value found in
+    // one can be cached until the version moves on
+    static unsigned version();
+
+    // Whether a frame other than a global one currently binds sym. While
+    // none does, looking sym up from any frame ends in the global one
+    static bool bound_locally(atom sym);
+
+    // New reference to the bound value, or an error if it is unbound
+    lval *get(atom sym) const;
+    void put(atom sym, const lval *const val);
+    void def(atom sym, const lval *const val);
 
     void add_builtin_function(const std::string &name, lbuiltin func);
     void add_builtin_macro(const std::string &name, lbuiltin func);
@@ -2,7 +2,10 @@
 #include <linenoise.h>
 #include "generated.hpp"
 #include "lispy_config.h"
+#include "gc.hpp"
 #include "lval.hpp"
+#include "pool.hpp"
+#include "vm.hpp"
 
 using std::cerr;
 using std::cout;
@@ -18,6 +21,17 @@ lispy::lispy()
       interactive_arg("i", "interactive",
                       "Run REPL, even when -e is present or files are given",
                       false),
+      mem_stats_arg("m", "memstats", "Print allocation statistics on exit",
+                    false),
+      gc_growth_arg("", "gc-growth",
+                    "Heap growth between cycle collections (default 2)",
+                    false, gc::config().growth_factor, "factor"),
+      gc_threshold_arg("", "gc-threshold",
+                       "Minimum number of containers before collecting",
+                       false, gc::config().min_threshold, "count"),
+      max_stack_arg("", "max-stack",
+                    "Megabytes the evaluation stack may take (default 256)",
+                    false, vm::config().max_stack >> 20, "megabytes"),
       eval_args("e", "eval", "Eval program given as string", false, "program"),
       file_args("files", "Read programs from scripts", false, "file") {
     integer_parser = mpc_new("integer");
@@ -37,11 +51,14 @@ lispy::lispy()
               sexpr_parser, qexpr_parser, expr_parser, comment_parser,
               command_parser, lispy_parser);
 
+    env.global = true;
     builtin::add_builtins(&env);
+    gc::add_root(&env);
     _instance = this;
 }
 
 lispy::~lispy() {
+    gc::remove_root(&env);
     mpc_cleanup(11, integer_parser, decimal_parser, number_parser,
                 symbol_parser, string_parser, sexpr_parser, qexpr_parser,
                 expr_parser, comment_parser, command_parser, lispy_parser);
@@ -59,6 +76,10 @@ int lispy::run(int argc, char *argv[]) {
 
     try {
         cmd_line.add(interactive_arg);
+        cmd_line.add(mem_stats_arg);
+        cmd_line.add(gc_growth_arg);
+        cmd_line.add(gc_threshold_arg);
+        cmd_line.add(max_stack_arg);
         cmd_line.add(eval_args);
         cmd_line.add(file_args);
         cmd_line.parse(argc, argv);
@@ -67,6 +88,10 @@ int lispy::run(int argc, char *argv[]) {
         auto evals = eval_args.getValue();
         auto files = file_args.getValue();
 
+        gc::config().growth_factor = gc_growth_arg.getValue();
+        gc::config().min_threshold = gc_threshold_arg.getValue();
+        vm::config().max_stack = max_stack_arg.getValue() << 20;
+
         if (!eval_strings(evals) || !load_files(files)) {
             return 1;
         }
@@ -76,6 +101,10 @@ int lispy::run(int argc, char *argv[]) {
             builtin::add_builtin_commands(&env);
             run_interactive();
         }
+
+        if (mem_stats_arg.getValue()) {
+            cerr << pool::stats() << '\n' << gc::stats() << endl;
+        }
     } catch (TCLAP::ArgException &e) {
         cerr << "Error: " << e.error() << " for arg " << e.argId() << endl;
         return 1;
@@ -90,7 +119,7 @@ bool lispy::load_prelude() {
 
     if (expr->type == lval_type::error) {
         cerr << *expr << endl;
-        delete expr;
+        lval::release(expr);
         return false;
     }
 
@@ -98,15 +127,19 @@ bool lispy::load_prelude() {
         auto x = lval::eval(&env, expr->pop_first());
         if (x->type == lval_type::error) {
             cerr << "Failed to load prelude: " << *x << endl;
-            delete x;
-            delete expr;
+            lval::release(x);
+            lval::release(expr);
             return false;
         }
 
-        delete x;
+        lval::release(x);
+        gc::safe_point({expr});
     }
 
-    delete expr;
+    lval::release(expr);
+
+    // Calls to and and or short-circuit from now on
+    vm::bind_intrinsics(&env);
     return true;
 }
 
@@ -142,8 +175,9 @@ void lispy::run_interactive() {
             lval *result = lval::read((mpc_ast_t *)r.output);
             result = lval::eval(&env, result);
             bool break_loop = process_interactive_result(result);
-            delete result;
+            lval::release(result);
             mpc_ast_delete((mpc_ast_t *)r.output);
+            collect_garbage();
             if (break_loop) break;
         } else {
             /* Otherwise Print the Error */
@@ -173,6 +207,17 @@ bool lispy::process_interactive_result(lval *result) {
     return false;
 }
 
+void lispy::collect_garbage() {
+    if (flags & LISPY_FLAG_COLLECT) {
+        flags &= ~LISPY_FLAG_COLLECT;
+        auto freed = gc::collect();
+        cout << "Collected " << freed << " containers\n"
+             << gc::stats() << endl;
+    } else {
+        gc::safe_point();
+    }
+}
+
 bool lispy::load_files(const vector<string> &files) {
     for (auto file: files) {
         lval *args = lval::sexpr({new lval(file)});
@@ -180,11 +225,12 @@ bool lispy::load_files(const vector<string> &files) {
 
         if (x->type == lval_type::error) {
             cout << *x << endl;
-            delete x;
+            lval::release(x);
             return false;
         }
 
-        delete x;
+        lval::release(x);
+        gc::safe_point();
     }
 
     return true;
@@ -197,7 +243,7 @@ bool lispy::eval_strings(const vector<string> &strings) {
 
         if (expr->type == lval_type::error) {
             cout << *expr << endl;
-            delete expr;
+            lval::release(expr);
             return false;
         }
 
@@ -205,11 +251,12 @@ bool lispy::eval_strings(const vector<string> &strings) {
         cout << *x << endl;
 
         if (x->type == lval_type::error) {
-            delete x;
+            lval::release(x);
             return false;
         }
 
-        delete x;
+        lval::release(x);
+        gc::safe_point();
     }
 
     return true;
@@ -10,6 +10,7 @@
 #define LISPY_FLAG_INTERACTIVE 0x1
 #define LISPY_FLAG_CLEAR_OUTPUT 0x2
 #define LISPY_FLAG_EXIT 0x4
+#define LISPY_FLAG_COLLECT 0x8
 
 class lispy {
    public:
@@ -30,6 +31,7 @@ class lispy {
     bool load_prelude();
     void run_interactive();
     bool process_interactive_result(lval *result);
+    void collect_garbage();
     bool load_files(const std::vector<std::string> &files);
     bool eval_strings(const std::vector<std::string> &strings);
 
@@ -51,6 +53,10 @@ class lispy {
     // Command line arguments parsing
     TCLAP::CmdLine cmd_line;
     TCLAP::SwitchArg interactive_arg;
+    TCLAP::SwitchArg mem_stats_arg;
+    TCLAP::ValueArg<double> gc_growth_arg;
+    TCLAP::ValueArg<size_t> gc_threshold_arg;
+    TCLAP::ValueArg<size_t> max_stack_arg;
     TCLAP::MultiArg<std::string> eval_args;
     TCLAP::UnlabeledMultiArg<std::string> file_args;
 };
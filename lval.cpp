@@ -3,8 +3,10 @@
 #include <string>
 #include <vector>
 #include "builtin.hpp"
+#include "gc.hpp"
 #include "lenv.hpp"
 #include "lval_error.hpp"
+#include "vm.hpp"
 
 using std::ostream;
 using std::string;
@@ -50,59 +52,103 @@ bool should_skip_child(mpc_ast_t *child) {
     return it != end;
 }
 
+// Range of integers preallocated as immortal values
+const long small_int_min = -128;
+const long small_int_max = 1024;
+
+lval *make_immortal(lval *v) {
+    v->immortal = true;
+    return v;
+}
+
+lval *const true_value = make_immortal(new lval(true));
+lval *const false_value = make_immortal(new lval(false));
+lval *const nil_value = make_immortal(new lval(lval_type::qexpr));
+
+// Created on first use
+lval *small_ints[small_int_max - small_int_min + 1];
+
+// Separates the fixed formals from the variadic one
+const atom variadic_sym = atom::intern("&");
+
+const unsigned short lval::unresolved;
+
 lval::lval(lval_type type) {
     this->type = type;
-    this->body = nullptr;
-    this->formals = nullptr;
-    this->env = nullptr;
-    this->boolean = false;
-    this->dec = 0.0;
-    this->integ = 0;
+    this->has_builtin = false;
+    switch (type) {
+        case lval_type::integer:
+            this->integ = 0;
+            break;
+        case lval_type::decimal:
+            this->dec = 0.0;
+            break;
+        case lval_type::boolean:
+            this->boolean = false;
+            break;
+        case lval_type::error:
+            new (&this->err) string();
+            break;
+        case lval_type::string:
+            new (&this->str) string();
+            break;
+        case lval_type::func:
+        case lval_type::macro:
+        case lval_type::command:
+            this->has_builtin = true;
+            new (&this->builtin) lbuiltin();
+            break;
+        case lval_type::sexpr:
+        case lval_type::qexpr:
+            new (&this->cells) cell_type();
+            gc::track(this);
+            break;
+        default:
+            break;
+    }
 }
 
 lval::lval(long num) {
     this->type = lval_type::integer;
+    this->has_builtin = false;
     this->integ = num;
-    this->body = nullptr;
-    this->formals = nullptr;
-    this->env = nullptr;
-    this->boolean = false;
-    this->dec = 0.0;
 }
 
 lval::lval(double num) {
     this->type = lval_type::decimal;
+    this->has_builtin = false;
     this->dec = num;
-    this->body = nullptr;
-    this->formals = nullptr;
-    this->env = nullptr;
-    this->boolean = false;
-    this->integ = 0;
 }
 
 lval::lval(bool boolean) {
     this->type = lval_type::boolean;
+    this->has_builtin = false;
     this->boolean = boolean;
-    this->body = nullptr;
-    this->formals = nullptr;
-    this->env = nullptr;
-    this->dec = 0.0;
-    this->integ = 0;
 }
 
 lval::lval(string str) {
     this->type = lval_type::string;
-    this->str = str;
-    this->body = nullptr;
-    this->formals = nullptr;
-    this->env = nullptr;
-    this->boolean = false;
-    this->dec = 0.0;
-    this->integ = 0;
+    this->has_builtin = false;
+    new (&this->str) string(std::move(str));
+}
+
+lval::lval(lval_type type, lbuiltin fun) {
+    this->type = type;
+    this->has_builtin = true;
+    new (&this->builtin) lbuiltin(std::move(fun));
 }
 
-lval::lval(const lval &other) {
-    this->type = other.type;
+lval::lval(lval_type type, lval *formals, lval *body) {
+    this->type = type;
+    this->has_builtin = false;
+    this->lambda.bound = nullptr;
+    this->lambda.formals = formals;
+    this->lambda.body = body;
+    this->lambda.code = nullptr;
+    gc::track(this);
+}
+
+lval::lval(const lval &other): lval(other.type) {
     switch (this->type) {
         case lval_type::integer:
             this->integ = other.integ;
@@ -126,20 +172,22 @@ lval::lval(const lval &other) {
         case lval_type::func:
         case lval_type::macro:
         case lval_type::command:
-            if (other.builtin) {
+            if (other.has_builtin) {
                 this->builtin = other.builtin;
             } else {
-                this->builtin = nullptr;
-                this->env = new lenv(other.env);
-                this->formals = new lval(other.formals);
-                this->body = new lval(other.body);
+                this->builtin.~lbuiltin();
+                this->has_builtin = false;
+                this->lambda.bound =
+                    other.lambda.bound ? copy(other.lambda.bound) : nullptr;
+                this->lambda.formals = copy(other.lambda.formals);
+                this->lambda.body = copy(other.lambda.body);
+                this->lambda.code = vm::copy(other.lambda.code);
+                gc::track(this);
             }
             break;
         case lval_type::sexpr:
         case lval_type::qexpr:
-            std::transform(other.cells.begin(), other.cells.end(),
-                           std::back_inserter(this->cells),
-                           [](auto cell) { return new lval(cell); });
+            this->cells = other.cells;
             break;
         default:
             break;
@@ -148,15 +196,17 @@ lval::lval(const lval &other) {
 
 lval::lval(const lval *const other): lval(*other) {}
 
-lval *lval::symbol(string sym) {
+lval *lval::symbol(atom sym) {
     auto val = new lval(lval_type::symbol);
-    val->sym = sym;
+    val->sym = {sym, 0, unresolved, 0, nullptr};
     return val;
 }
 
-lval *lval::cname(string sym) {
+lval *lval::symbol(const string &sym) { return symbol(atom::intern(sym)); }
+
+lval *lval::cname(const string &sym) {
     auto val = new lval(lval_type::cname);
-    val->sym = sym;
+    val->sym = {atom::intern(sym), 0, unresolved, 0, nullptr};
     return val;
 }
 
@@ -167,39 +217,21 @@ lval *lval::error(string err) {
 }
 
 lval *lval::function(lbuiltin fun) {
-    auto val = new lval(lval_type::func);
-    val->builtin = fun;
-    return val;
+    return new lval(lval_type::func, fun);
 }
 
 lval *lval::function(lval *formals, lval *body) {
-    auto val = new lval(lval_type::func);
-    val->builtin = nullptr;
-    val->formals = formals;
-    val->body = body;
-    val->env = new lenv();
-    return val;
+    return new lval(lval_type::func, formals, body);
 }
 
-lval *lval::macro(lbuiltin fun) {
-    auto val = new lval(lval_type::macro);
-    val->builtin = fun;
-    return val;
-}
+lval *lval::macro(lbuiltin fun) { return new lval(lval_type::macro, fun); }
 
 lval *lval::macro(lval *formals, lval *body) {
-    auto val = new lval(lval_type::macro);
-    val->builtin = nullptr;
-    val->formals = formals;
-    val->body = body;
-    val->env = new lenv();
-    return val;
+    return new lval(lval_type::macro, formals, body);
 }
 
 lval *lval::command(lbuiltin fun) {
-    auto val = new lval(lval_type::command);
-    val->builtin = fun;
-    return val;
+    return new lval(lval_type::command, fun);
 }
 
 lval *lval::sexpr() {
@@ -224,15 +256,117 @@ lval *lval::qexpr(std::initializer_list<lval *> cells) {
     return val;
 }
 
+lval *lval::make(long num) {
+    if (num >= small_int_min && num <= small_int_max) {
+        auto &v = small_ints[num - small_int_min];
+        if (!v) v = make_immortal(new lval(num));
+        return v;
+    }
+
+    return new lval(num);
+}
+
+lval *lval::make(double num) { return new lval(num); }
+
+lval *lval::make(bool boolean) { return boolean ? true_value : false_value; }
+
+lval *lval::nil() { return nil_value; }
+
+lval *lval::copy(const lval *v) {
+    if (v->immortal) return const_cast<lval *>(v);
+    if (v->type == lval_type::qexpr && v->cells.empty()) return nil();
+
+    v->refs++;
+    return const_cast<lval *>(v);
+}
+
+lval *lval::unshare(lval *v) {
+    if (!v->is_shared()) return v;
+
+    auto clone = new lval(v);
+    release(v);
+    return clone;
+}
+
+void lval::release(lval *v) {
+    if (!v->immortal && --v->refs == 0) delete v;
+}
+
 lval::~lval() {
-    for (auto cell: cells) {
-        delete cell;
+    if (is_container()) gc::untrack(this);
+
+    switch (type) {
+        case lval_type::error:
+            err.~string();
+            break;
+        case lval_type::string:
+            str.~string();
+            break;
+        case lval_type::func:
+        case lval_type::macro:
+        case lval_type::command:
+            if (has_builtin) {
+                builtin.~lbuiltin();
+            } else {
+                release(lambda.formals);
+                release(lambda.body);
+                if (lambda.bound) release(lambda.bound);
+                vm::release(lambda.code);
+            }
+            break;
+        case lval_type::sexpr:
+        case lval_type::qexpr:
+            cells.~cell_type();
+            break;
+        default:
+            break;
+    }
+}
+
+void *lval::operator new(size_t size) { return pool::allocate(size); }
+
+void lval::operator delete(void *ptr, size_t size) {
+    pool::deallocate(ptr, size);
+}
+
+bool lval::is_shared() const { return immortal || refs > 1; }
+
+bool lval::is_container() const {
+    switch (type) {
+        case lval_type::func:
+        case lval_type::macro:
+        case lval_type::command:
+            return !has_builtin;
+        case lval_type::sexpr:
+        case lval_type::qexpr:
+            return true;
+        default:
+            return false;
     }
+}
 
-    if ((type == lval_type::func || type == lval_type::macro) && !builtin) {
-        delete formals;
-        delete body;
-        delete env;
+void lval::clear() {
+    switch (type) {
+        case lval_type::func:
+        case lval_type::macro:
+        case lval_type::command:
+            if (!has_builtin) {
+                release(lambda.formals);
+                release(lambda.body);
+                lambda.formals = nil();
+                lambda.body = nil();
+                if (lambda.bound) release(lambda.bound);
+                lambda.bound = nullptr;
+                vm::release(lambda.code);
+                lambda.code = nullptr;
+            }
+            break;
+        case lval_type::sexpr:
+        case lval_type::qexpr:
+            cells.clear();
+            break;
+        default:
+            break;
     }
 }
 
@@ -258,100 +392,136 @@ double lval::get_number() const {
     }
 }
 
-lval *lval::pop(const iter &it) {
-    auto x = *it;
-    cells.erase(it);
-    return x;
-}
+lval *lval::pop(const iter &it) { return cells.pop(it); }
 
 lval *lval::pop(size_t i) {
-    auto it = cells.begin();
-    for (size_t pos = 0; pos < i; pos++, ++it) {
-    }
-
-    return pop(it);
+    return i == 0 ? pop_first() : pop(cells.begin() + i);
 }
 
-lval *lval::pop_first() { return pop(cells.begin()); }
+lval *lval::pop_first() { return cells.pop_front(); }
 
 lval *lval::call(lenv *e, lval *a) {
-    if (builtin) return builtin(e, a);
+    if (has_builtin) return builtin(e, a);
 
-    auto given = a->cells.size();
-    auto total = formals->cells.size();
+    lval *result;
+    auto env = bind(e, a, result);
+    if (!env) return result;
 
-    while (!a->cells.empty()) {
-        if (formals->cells.empty()) {
-            delete a;
-            return error(lerr::too_many_args(given, total));
-        }
+    env->parent = e;
+    return vm::run(env, lambda.code);
+}
 
-        auto sym = formals->pop_first();
+size_t lval::bound_count() const {
+    return lambda.bound ? lambda.bound->cells.size() : 0;
+}
 
-        if (sym->sym == "&") {
-            if (formals->cells.size() != 1) {
-                delete a;
-                return error(lerr::function_format_invalid());
-            }
+lenv *lval::bind(lenv *e, lval *a, lval *&result) {
+    const auto &cells = a->cells;
+    auto env = bind(e, cells.begin(), cells.size(), result);
+    release(a);
+    return env;
+}
 
-            auto nsym = formals->pop_first();
+lenv *lval::bind(lenv *e, lval *const *args, size_t given, lval *&result) {
+    const auto &formals = lambda.formals->cells;
+    auto total = formals.size();
+    size_t next = bound_count();
+    bool macro = this->type == lval_type::macro;
 
-            if (this->type == lval_type::macro) {
-                for (auto &cell: a->cells) {
-                    cell = lval::qexpr({cell});
-                }
-            }
+    size_t fixed = next;
+    while (fixed < total && formals[fixed]->sym.name != variadic_sym) fixed++;
 
-            env->put(nsym->sym, builtin::list(e, a));
-            delete sym;
-            delete nsym;
-            break;
+    // Partial application. The result shares everything with the function
+    // but the arguments given so far, which are only bound once it has all
+    if (next + given < fixed) {
+        auto bound = sexpr();
+        if (lambda.bound) {
+            for (auto cell: lambda.bound->cells) {
+                bound->cells.push_back(copy(cell));
+            }
         }
 
-        auto val = a->pop_first();
-        if (this->type == lval_type::macro) {
-            val = lval::qexpr({val});
+        for (size_t i = 0; i < given; i++) {
+            auto val = copy(args[i]);
+            bound->cells.push_back(macro ? lval::qexpr({val}) : val);
         }
 
-        env->put(sym->sym, val);
-        delete sym;
-        delete val;
+        auto partial = new lval(type, copy(lambda.formals), copy(lambda.body));
+        partial->lambda.bound = bound;
+        partial->lambda.code = vm::copy(lambda.code);
+        result = partial;
+        return nullptr;
+    }
+
+    // Arguments are bound in a new frame, so the function is never modified
+    // and callers can keep sharing it
+    auto env = lenv::frame();
+    if (lambda.bound) {
+        for (size_t i = 0; i < next; i++) {
+            env->put(formals[i]->sym.name, lambda.bound->cells[i]);
+        }
     }
 
-    delete a;
+    for (size_t i = 0; i < given; i++) {
+        if (next == total) {
+            lenv::release(env);
+            result = error(lerr::too_many_args(given, total - bound_count()));
+            return nullptr;
+        }
+
+        auto sym = formals[next++];
+
+        if (sym->sym.name == variadic_sym) {
+            if (total - next != 1) {
+                lenv::release(env);
+                result = error(lerr::function_format_invalid());
+                return nullptr;
+            }
+
+            auto rest = sexpr();
+            for (; i < given; i++) {
+                auto val = copy(args[i]);
+                rest->cells.push_back(macro ? lval::qexpr({val}) : val);
+            }
 
-    if (!formals->cells.empty() && formals->cells.front()->sym == "&") {
-        if (formals->cells.size() != 2) {
-            return error(lerr::function_format_invalid());
+            auto list = builtin::list(e, rest);
+            env->put(formals[next++]->sym.name, list);
+            release(list);
+            break;
         }
 
-        delete formals->pop_first();
-        auto sym = formals->pop_first();
-        auto val = lval::qexpr();
-        env->put(sym->sym, val);
-        delete sym;
-        delete val;
+        if (macro) {
+            auto val = lval::qexpr({copy(args[i])});
+            env->put(sym->sym.name, val);
+            release(val);
+        } else {
+            env->put(sym->sym.name, args[i]);
+        }
     }
 
-    if (formals->cells.empty()) {
-        env->parent = e;
+    if (next < total && formals[next]->sym.name == variadic_sym) {
+        if (total - next != 2) {
+            lenv::release(env);
+            result = error(lerr::function_format_invalid());
+            return nullptr;
+        }
 
-        auto v = new lval(body);
-        return eval_qexpr(env, v);
-    } else {
-        return new lval(this);
+        env->put(formals[next + 1]->sym.name, lval::nil());
+        next += 2;
     }
+
+    return env;
 }
 
 lval *lval::take(lval *v, const iter &it) {
     auto x = v->pop(it);
-    delete v;
+    release(v);
     return x;
 }
 
 lval *lval::take(lval *v, size_t i) {
     auto x = v->pop(i);
-    delete v;
+    release(v);
     return x;
 }
 
@@ -360,13 +530,13 @@ lval *lval::take_first(lval *v) { return take(v, v->cells.begin()); }
 lval *lval::read_integer(mpc_ast_t *t) {
     errno = 0;
     long x = strtol(t->contents, NULL, 10);
-    return errno != ERANGE ? new lval(x) : error(lerr::bad_num());
+    return errno != ERANGE ? make(x) : error(lerr::bad_num());
 }
 
 lval *lval::read_decimal(mpc_ast_t *t) {
     errno = 0;
     double x = strtod(t->contents, NULL);
-    return errno != ERANGE ? new lval(x) : error(lerr::bad_num());
+    return errno != ERANGE ? make(x) : error(lerr::bad_num());
 }
 
 lval *lval::read_string(mpc_ast_t *t) {
@@ -404,90 +574,139 @@ lval *lval::read(mpc_ast_t *t) {
     return x;
 }
 
-lval *lval::eval(lenv *e, lval *v) {
-    if (v->type == lval_type::symbol || v->type == lval_type::cname) {
-        auto x = e->get(v->sym);
-        delete v;
-        return x;
+const lval *lval::lookup(lenv *e, const symbol_type &sym) {
+    if (sym.slot != lval::unresolved) {
+        return e->lookup(sym.name, sym.depth, sym.slot);
     }
 
-    if (v->type == lval_type::sexpr) return eval_sexpr(e, v);
-
-    return v;
+    return lookup_global(e, sym);
 }
 
-lval *lval::eval_sexpr(lenv *e, lval *v) {
-    if (v->cells.empty()) return v;
+const lval *lval::lookup_global(lenv *e, const symbol_type &sym) {
+    if (lenv::bound_locally(sym.name)) return e->lookup(sym.name);
 
-    auto begin = v->cells.begin();
-    *begin = eval(e, *begin);
+    if (sym.cache_version != lenv::version()) {
+        sym.cached = e->lookup(sym.name);
+        sym.cache_version = lenv::version();
+    }
 
-    if (v->cells.size() == 1) {
-        auto val = take_first(v);
-        if ((*begin)->type == lval_type::command) {
-            return val->call(e, lval::sexpr());
+    return sym.cached;
+}
+
+lval *lval::evaluate(lenv *e, const lval *v) {
+    switch (v->type) {
+        case lval_type::symbol:
+        case lval_type::cname: {
+            auto &sym = v->sym;
+            auto x = lookup(e, sym);
+            return x ? copy(x) : error(lerr::unknown_sym(sym.name.name()));
         }
+        case lval_type::sexpr:
+            return evaluate_sexpr(e, v);
+        default:
+            return copy(v);
+    }
+}
 
-        return val;
+lval *lval::evaluate_sexpr(lenv *e, const lval *v) {
+    const auto &cells = v->cells;
+    if (cells.empty()) {
+        return v->type == lval_type::sexpr ? copy(v) : sexpr();
     }
 
-    auto f = v->pop_first();
+    if (vm::native_stack_exhausted()) return error(lerr::stack_exhausted());
+
+    gc::eval_scope scope;
+
+    auto f = evaluate(e, cells.front());
+
+    if (cells.size() == 1) {
+        if (f->type != lval_type::command) return f;
+
+        auto result = f->call(e, sexpr());
+        release(f);
+        return result;
+    }
+
+    lval *args;
 
     switch (f->type) {
         case lval_type::error:
-            delete v;
             return f;
 
         case lval_type::func: {
-            v = eval_cells(e, v);
-            if (v->type == lval_type::error) {
-                delete f;
-                return v;
+            auto result = vm::short_circuit(e, f, v);
+            if (result) {
+                release(f);
+                return result;
             }
 
-            auto result = f->call(e, v);
-            delete f;
+            // Every argument is evaluated before the first error is taken
+            args = sexpr();
+            for (auto it = cells.begin() + 1; it != cells.end(); ++it) {
+                args->cells.push_back(evaluate(e, *it));
+            }
 
-            return result;
+            for (auto it = args->cells.begin(); it != args->cells.end();
+                 ++it) {
+                if ((*it)->type == lval_type::error) {
+                    release(f);
+                    return take(args, it);
+                }
+            }
+            break;
         }
         case lval_type::macro:
-        case lval_type::command: {
-            v->type = lval_type::qexpr;
-            auto result = f->call(e, v);
-            delete f;
+        case lval_type::command:
+            args = qexpr();
+            for (auto it = cells.begin() + 1; it != cells.end(); ++it) {
+                args->cells.push_back(copy(*it));
+            }
+            break;
 
-            return result;
-        }
-        default:
+        default: {
             auto type = f->type;
-            delete f;
-            delete v;
+            release(f);
             return error(lerr::sexpr_not_function(type));
+        }
     }
+
+    auto result = f->call(e, args);
+    release(f);
+    return result;
+}
+
+lval *lval::eval(lenv *e, lval *v) {
+    auto result = evaluate(e, v);
+    release(v);
+    return result;
 }
 
-lval *lval::eval_qexpr(lenv *e, lval *v) {
-    v->type = lval_type::sexpr;
-    return eval_sexpr(e, v);
+lval *lval::eval_sexpr(lenv *e, lval *v) {
+    auto result = evaluate_sexpr(e, v);
+    release(v);
+    return result;
 }
 
+lval *lval::eval_qexpr(lenv *e, lval *v) { return eval_sexpr(e, v); }
+
 lval *lval::eval_cells(lenv *e, lval *v) {
-    std::transform(v->cells.begin(), v->cells.end(), v->cells.begin(),
-                   std::bind(eval, e, std::placeholders::_1));
+    auto result = sexpr();
+    for (auto cell: v->cells) result->cells.push_back(evaluate(e, cell));
+    release(v);
 
-    for (auto it = v->cells.begin(); it != v->cells.end(); ++it) {
-        if ((*it)->type == lval_type::error) {
-            return take(v, it);
-        }
+    for (auto it = result->cells.begin(); it != result->cells.end(); ++it) {
+        if ((*it)->type == lval_type::error) return take(result, it);
     }
 
-    return v;
+    return result;
 }
 
-ostream &lval::print_expr(ostream &os, char open, char close) const {
+ostream &lval::print_expr(ostream &os, char open, char close,
+                          size_t from) const {
     os << open;
 
-    for (auto it = cells.begin(); it != cells.end();) {
+    for (auto it = cells.begin() + from; it != cells.end();) {
         os << **it;
 
         if (++it != cells.end()) os << ' ';
@@ -519,25 +738,29 @@ ostream &operator<<(ostream &os, const lval &value) {
 
         case lval_type::symbol:
         case lval_type::cname:
-            return os << value.sym;
+            return os << value.sym.name;
 
         case lval_type::string:
             return value.print_str(os);
 
         case lval_type::func:
-            if (value.builtin) {
+            if (value.has_builtin) {
                 return os << "<builtin function>";
             } else {
-                return os << "(\\ " << *value.formals << ' ' << *value.body
-                          << ')';
+                os << "(\\ ";
+                value.lambda.formals->print_expr(os, '{', '}',
+                                                 value.bound_count());
+                return os << ' ' << *value.lambda.body << ')';
             }
             break;
         case lval_type::macro:
-            if (value.builtin) {
+            if (value.has_builtin) {
                 return os << "<builtin macro>";
             } else {
-                return os << "(\\! " << *value.formals << ' ' << *value.body
-                          << ')';
+                os << "(\\! ";
+                value.lambda.formals->print_expr(os, '{', '}',
+                                                 value.bound_count());
+                return os << ' ' << *value.lambda.body << ')';
             }
             break;
         case lval_type::command:
@@ -591,20 +814,31 @@ bool lval::operator==(const lval &other) const {
             return this->err == other.err;
         case lval_type::symbol:
         case lval_type::cname:
-            return this->sym == other.sym;
+            return this->sym.name == other.sym.name;
         case lval_type::string:
             return this->str == other.str;
 
         case lval_type::func:
         case lval_type::macro:
         case lval_type::command:
-            if (this->builtin && other.builtin) {
+            if (this->has_builtin && other.has_builtin) {
                 auto a = this->builtin.target<lval *(*)(lenv *, lval *)>();
                 auto b = other.builtin.target<lval *(*)(lenv *, lval *)>();
+                // Builtins made at run time, like operators and memoized
+                // functions, are only equal to themselves
+                if (!a || !b) return this == &other;
                 return *a == *b;
-            } else if (!this->builtin && !other.builtin) {
-                return *this->formals == *other.formals &&
-                       *this->body == *other.body;
+            } else if (!this->has_builtin && !other.has_builtin) {
+                // Partial applications compare by the formals left
+                const auto &a = this->lambda.formals->cells;
+                const auto &b = other.lambda.formals->cells;
+                auto from_a = this->bound_count();
+                auto from_b = other.bound_count();
+                return a.size() - from_a == b.size() - from_b &&
+                       std::equal(a.begin() + from_a, a.end(),
+                                  b.begin() + from_b,
+                                  [](auto x, auto y) { return *x == *y; }) &&
+                       *this->lambda.body == *other.lambda.body;
             } else {
                 return false;
             }
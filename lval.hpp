@@ -2,10 +2,12 @@
 #define LVAL_HPP
 
 #include <iostream>
-#include <list>
 #include <string>
+#include "atom.hpp"
 #include "builtin.hpp"
+#include "cells.hpp"
 #include "mpc.h"
+#include "pool.hpp"
 
 enum class lval_type {
     integer,
@@ -27,26 +29,71 @@ std::ostream &operator<<(std::ostream &os, const lval_type &type);
 
 struct lenv;
 
-struct lval {
-    lval_type type;
+namespace vm {
+struct chunk;
+}
 
-    long integ;
-    double dec;
-    bool boolean;
-    std::string err;
-    std::string sym;
-    std::string str;
+struct lval {
+    using cell_type = cell_list;
 
-    lbuiltin builtin;
-    lenv *env;
-    lval *formals;
-    lval *body;
+    using iter = cell_type::iterator;
 
-    using cell_type = std::list<lval *>;
+    // Symbols naming a parameter of the function they appear in are resolved
+    // to the frame depth and slot the parameter will be bound to when the
+    // function is built, see lenv::lookup
+    struct symbol_type {
+        atom name;
+        unsigned short depth;
+        unsigned short slot;
+        // Inline cache of the global binding found last time. It holds
+        // while the global version is still cache_version and no local
+        // frame binds the name. Updated even through const code
+        mutable unsigned cache_version;
+        mutable const lval *cached;
+    };
+
+    static const unsigned short unresolved = 0xffff;
+
+    struct lambda_type {
+        // Arguments given so far by partial application, for the first
+        // formals, or null if there are none. They are only bound once the
+        // function gets the rest. Copies of the function share it
+        lval *bound;
+        lval *formals;
+        lval *body;
+        // Compiled body, see vm.hpp. Shared with copies and partial
+        // applications
+        vm::chunk *code;
+    };
 
-    cell_type cells;
+    lval_type type;
 
-    using iter = cell_type::iterator;
+    // Whether a function, macro or command is native (builtin) or a lambda
+    bool has_builtin;
+
+    // Immortal values are shared by everyone and never freed
+    bool immortal = false;
+
+    // Number of owners. Values are immutable while shared, so anything that
+    // modifies one in place has to unshare it first
+    mutable unsigned refs = 1;
+
+    // Collector bookkeeping, see gc.hpp
+    bool marked = false;
+    unsigned gc_slot;
+
+    // Only the member matching the type is alive
+    union {
+        long integ;
+        double dec;
+        bool boolean;
+        std::string err;
+        symbol_type sym;
+        std::string str;
+        lbuiltin builtin;
+        lambda_type lambda;
+        cell_type cells;
+    };
 
     explicit lval(lval_type type);
 
@@ -58,13 +105,19 @@ struct lval {
 
     explicit lval(std::string str);
 
+    lval(lval_type type, lbuiltin fun);
+
+    lval(lval_type type, lval *formals, lval *body);
+
     lval(const lval &other);
 
     explicit lval(const lval *const other);
 
-    static lval *symbol(std::string err);
+    static lval *symbol(atom sym);
+
+    static lval *symbol(const std::string &sym);
 
-    static lval *cname(std::string err);
+    static lval *cname(const std::string &sym);
 
     static lval *error(std::string err);
 
@@ -86,8 +139,34 @@ struct lval {
 
     static lval *qexpr(std::initializer_list<lval *> cells);
 
+    static lval *make(long num);
+
+    static lval *make(double num);
+
+    static lval *make(bool boolean);
+
+    static lval *nil();
+
+    static lval *copy(const lval *v);
+
+    static lval *unshare(lval *v);
+
+    static void release(lval *v);
+
     ~lval();
 
+    static void *operator new(size_t size);
+
+    static void operator delete(void *ptr, size_t size);
+
+    bool is_shared() const;
+
+    // Whether it can hold references to other values
+    bool is_container() const;
+
+    // Drops the references to other values
+    void clear();
+
     bool is_number() const;
     double get_number() const;
 
@@ -99,6 +178,17 @@ struct lval {
 
     lval *call(lenv *e, lval *a);
 
+    // Number of formals of a lambda given by partial application so far
+    size_t bound_count() const;
+
+    // Binds the arguments in a to the formals of a lambda, in a new frame
+    // returned once all of them are given. Otherwise returns null and sets
+    // result to the partial application or an error
+    lenv *bind(lenv *e, lval *a, lval *&result);
+
+    // Same as above with the given arguments borrowed instead
+    lenv *bind(lenv *e, lval *const *args, size_t given, lval *&result);
+
     static lval *take(lval *v, const iter &it);
 
     static lval *take(lval *v, size_t i);
@@ -113,17 +203,37 @@ struct lval {
 
     static lval *read(mpc_ast_t *t);
 
+    // Value bound to sym as seen from e, or null if it is unbound
+    static const lval *lookup(lenv *e, const symbol_type &sym);
+
+    // Same as lookup, skipping the resolved slot. Uses the inline cache
+    // while no local frame binds the name
+    static const lval *lookup_global(lenv *e, const symbol_type &sym);
+
+    // Evaluates v in e without consuming or modifying it, code is only ever
+    // read. Only the result is new, and it may share parts of v
+    static lval *evaluate(lenv *e, const lval *v);
+
+    // Same as evaluate for the cells of v as an S-expression, whatever the
+    // type of v
+    static lval *evaluate_sexpr(lenv *e, const lval *v);
+
+    // Consuming versions of the above, v is released once evaluated
     static lval *eval(lenv *e, lval *v);
 
     static lval *eval_sexpr(lenv *e, lval *v);
 
     static lval *eval_qexpr(lenv *e, lval *v);
 
+    // Evaluates every cell of v, returning them in an S-expression or the
+    // first error
     static lval *eval_cells(lenv *e, lval *v);
 
     friend std::ostream &operator<<(std::ostream &os, const lval &value);
 
-    std::ostream &print_expr(std::ostream &os, char open, char close) const;
+    // Prints the cells from position from on
+    std::ostream &print_expr(std::ostream &os, char open, char close,
+                             size_t from = 0) const;
     std::ostream &print_str(std::ostream &os) const;
 
     bool operator==(const lval &other) const;
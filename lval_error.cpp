@@ -85,6 +85,27 @@ string function_format_invalid() {
     return "Function format invalid. Symbol '&' not followed by single symbol.";
 }
 
+string passed_non_positive(const string &func) {
+    return "Function '" + func + "' passed a size that is not positive!";
+}
+
+string passed_non_memoized(const string &func) {
+    return "Function '" + func + "' passed a function that is not memoized!";
+}
+
+string passed_invalid_clause(const string &func) {
+    return "Function '" + func +
+           "' passed a clause that is not a list of two items!";
+}
+
+string no_selection_found() { return "No selection found"; }
+
+string no_case_found() { return "No case found"; }
+
+string stack_exhausted() {
+    return "Evaluation stack exhausted! Recursion is too deep.";
+}
+
 string could_not_load_library(const string &msg) {
     return "Cound not load library " + msg;
 }
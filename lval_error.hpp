@@ -22,6 +22,12 @@ std::string passed_empty_string(const std::string &func);
 std::string cant_define_non_sym(const std::string &func, lval_type got);
 std::string cant_define_mismatched_values(const std::string &func);
 std::string function_format_invalid();
+std::string passed_non_positive(const std::string &func);
+std::string passed_non_memoized(const std::string &func);
+std::string passed_invalid_clause(const std::string &func);
+std::string no_selection_found();
+std::string no_case_found();
+std::string stack_exhausted();
 std::string could_not_load_library(const std::string &msg);
 } // namespace lerr
 
@@ -0,0 +1,175 @@
+#include "memo.hpp"
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "lval.hpp"
+
+using std::vector;
+
+namespace memo {
+
+struct entry {
+    // Both retained
+    lval *args;
+    lval *result;
+};
+
+struct table {
+    // Retained
+    lval *f;
+    statistics stats;
+    // Most recently used first
+    std::list<entry> entries;
+    std::unordered_multimap<size_t, std::list<entry>::iterator> index;
+    // Neighbours in the list of every cache alive, see trace
+    table *prev = nullptr;
+    table *next = nullptr;
+
+    table(const lval *f, size_t capacity);
+    table(const table &other) = delete;
+    ~table();
+
+    // Drops the least recently used entry
+    void evict();
+};
+
+// Most recent cache alive. The list has no destructor of its own, so caches
+// can still be freed when the program exits
+thread_local table *newest = nullptr;
+
+table::table(const lval *f, size_t capacity)
+    : f(lval::copy(f)), stats({0, 0, 0, capacity}) {
+    next = newest;
+    if (next) next->prev = this;
+    newest = this;
+}
+
+table::~table() {
+    if (prev) prev->next = next;
+    if (next) next->prev = prev;
+    if (newest == this) newest = next;
+
+    lval::release(f);
+    for (auto &entry: entries) {
+        lval::release(entry.args);
+        lval::release(entry.result);
+    }
+}
+
+void table::evict() {
+    auto last = std::prev(entries.end());
+    auto range = index.equal_range(hash(last->args));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == last) {
+            index.erase(it);
+            break;
+        }
+    }
+
+    lval::release(last->args);
+    lval::release(last->result);
+    entries.erase(last);
+    stats.entries--;
+}
+
+lval *function::operator()(lenv *e, lval *a) const {
+    // The call may drop the last function sharing the cache
+    auto keep = cache;
+    auto &t = *keep;
+    auto h = hash(a);
+
+    auto range = t.index.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+        auto found = it->second;
+        if (*found->args == *a) {
+            t.entries.splice(t.entries.begin(), t.entries, found);
+            t.stats.hits++;
+            lval::release(a);
+            return lval::copy(found->result);
+        }
+    }
+
+    t.stats.misses++;
+
+    auto args = lval::sexpr();
+    for (auto cell: a->cells) args->cells.push_back(lval::copy(cell));
+
+    auto result = t.f->call(e, a);
+
+    // Errors are not cached, they may come from the state of the evaluator
+    // rather than the arguments
+    if (result->type == lval_type::error) {
+        lval::release(args);
+        return result;
+    }
+
+    t.entries.push_front({args, lval::copy(result)});
+    t.index.emplace(h, t.entries.begin());
+    t.stats.entries++;
+    if (t.stats.entries > t.stats.capacity) t.evict();
+
+    return result;
+}
+
+function make(const lval *f, size_t capacity) {
+    return {std::make_shared<table>(f, capacity)};
+}
+
+const statistics *stats(const lval *f) {
+    if (f->type != lval_type::func || !f->has_builtin) return nullptr;
+
+    auto memoized = f->builtin.target<function>();
+    return memoized ? &memoized->cache->stats : nullptr;
+}
+
+size_t combine(size_t seed, size_t h) {
+    return seed ^ (h + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+
+size_t hash(const lval *v) {
+    switch (v->type) {
+        case lval_type::integer:
+        case lval_type::decimal: {
+            // Integers and decimals are equal when their values are, and
+            // so are 0.0 and -0.0
+            auto num = v->get_number();
+            return num == 0 ? 0 : std::hash<double>()(num);
+        }
+        case lval_type::boolean:
+            return v->boolean;
+        case lval_type::symbol:
+        case lval_type::cname:
+            return v->sym.name.id;
+        case lval_type::string:
+            return std::hash<std::string>()(v->str);
+        case lval_type::error:
+            return std::hash<std::string>()(v->err);
+        case lval_type::func:
+        case lval_type::macro:
+        case lval_type::command:
+            // Partial applications of a lambda may equal other lambdas, they
+            // are only compared by the formals left
+            return v->has_builtin ? (size_t)v->type : hash(v->lambda.body);
+        case lval_type::sexpr:
+        case lval_type::qexpr: {
+            size_t h = (size_t)v->type;
+            for (auto cell: v->cells) h = combine(h, hash(cell));
+            return h;
+        }
+        default:
+            return 0;
+    }
+}
+
+void trace(vector<lval *> &values) {
+    for (auto t = newest; t; t = t->next) {
+        values.push_back(t->f);
+        for (auto &entry: t->entries) {
+            values.push_back(entry.args);
+            values.push_back(entry.result);
+        }
+    }
+}
+
+} // namespace memo
@@ -0,0 +1,50 @@
+#ifndef LISPY_MEMO_HPP
+#define LISPY_MEMO_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+struct lval;
+struct lenv;
+
+// Result caches of memoized functions, see the memo builtin. Arguments are
+// looked up by a structural hash and compared with lval::operator==, so 1 and
+// 1.0 find the same entry just like they are equal for ==. Only the most
+// recently used results are kept, up to the capacity of the cache.
+namespace memo {
+
+const size_t default_capacity = 1024;
+
+struct statistics {
+    size_t hits;
+    size_t misses;
+    size_t entries;
+    size_t capacity;
+};
+
+struct table;
+
+// Builtin calling a function through its cache. Copies share the cache
+struct function {
+    std::shared_ptr<table> cache;
+
+    lval *operator()(lenv *e, lval *a) const;
+};
+
+// Memoized version of f, which has to be pure for the results to be right
+function make(const lval *f, size_t capacity);
+
+// Statistics of memoized function f, or null if it is not one
+const statistics *stats(const lval *f);
+
+// Hash of v consistent with lval::operator==
+size_t hash(const lval *v);
+
+// Adds the values held by every cache alive to values. The collector has to
+// see them, caches are not values themselves
+void trace(std::vector<lval *> &values);
+
+} // namespace memo
+
+#endif // LISPY_MEMO_HPP
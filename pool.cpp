@@ -0,0 +1,92 @@
+#include "pool.hpp"
+#include <new>
+#include "lispy_config.h"
+
+namespace pool {
+
+// Blocks are rounded up to a multiple of the granularity, bigger requests go
+// straight to operator new
+const size_t granularity = 16;
+const size_t max_block_size = 256;
+const size_t size_classes = max_block_size / granularity;
+const size_t slab_size = 64 * 1024;
+
+struct free_block {
+    free_block *next;
+};
+
+// Slabs are never returned to the system, freed blocks go back to the free
+// list of their size class instead
+struct thread_pool {
+    free_block *free_lists[size_classes] = {};
+    statistics stats = {0, 0, 0};
+};
+
+thread_local thread_pool local;
+
+size_t size_class(size_t size) {
+    return size == 0 ? 0 : (size - 1) / granularity;
+}
+
+free_block *refill(size_t cls) {
+    auto block_size = (cls + 1) * granularity;
+    auto count = slab_size / block_size;
+    auto slab = static_cast<char *>(::operator new(count * block_size));
+
+    free_block *head = nullptr;
+    for (size_t i = count; i > 0; i--) {
+        auto block =
+            reinterpret_cast<free_block *>(slab + (i - 1) * block_size);
+        block->next = head;
+        head = block;
+    }
+
+    return head;
+}
+
+void *allocate(size_t size) {
+    auto &stats = local.stats;
+    stats.total++;
+    if (++stats.live > stats.peak) stats.peak = stats.live;
+
+#ifdef LISPY_POOL_ALLOCATOR
+    if (size <= max_block_size) {
+        auto cls = size_class(size);
+        auto &list = local.free_lists[cls];
+        if (!list) list = refill(cls);
+
+        auto block = list;
+        list = block->next;
+        return block;
+    }
+#endif
+
+    return ::operator new(size);
+}
+
+void deallocate(void *ptr, size_t size) {
+    if (!ptr) return;
+    local.stats.live--;
+
+#ifdef LISPY_POOL_ALLOCATOR
+    if (size <= max_block_size) {
+        auto &list = local.free_lists[size_class(size)];
+        auto block = static_cast<free_block *>(ptr);
+        block->next = list;
+        list = block;
+        return;
+    }
+#endif
+
+    ::operator delete(ptr);
+}
+
+const statistics &stats() { return local.stats; }
+
+std::ostream &operator<<(std::ostream &os, const statistics &stats) {
+    return os << "Live allocations: " << stats.live
+              << "\nPeak allocations: " << stats.peak
+              << "\nTotal allocations: " << stats.total;
+}
+
+} // namespace pool
@@ -0,0 +1,57 @@
+#ifndef LISPY_POOL_HPP
+#define LISPY_POOL_HPP
+
+#include <cstddef>
+#include <ostream>
+
+// Size-class allocator for the small objects the interpreter churns through
+// (lval, lenv and container nodes). Each thread keeps its own free lists, so
+// blocks are recycled without locking.
+namespace pool {
+
+struct statistics {
+    // Allocations not yet freed
+    size_t live;
+    // Highest value live has reached
+    size_t peak;
+    // Allocations made since the program started
+    size_t total;
+};
+
+void *allocate(size_t size);
+void deallocate(void *ptr, size_t size);
+
+// Statistics of the calling thread
+const statistics &stats();
+
+std::ostream &operator<<(std::ostream &os, const statistics &stats);
+
+template <typename T>
+struct allocator {
+    using value_type = T;
+
+    allocator() = default;
+
+    template <typename U>
+    allocator(const allocator<U> &) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(pool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *ptr, size_t n) { pool::deallocate(ptr, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const allocator<U> &) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const allocator<U> &) const {
+        return false;
+    }
+};
+
+} // namespace pool
+
+#endif // LISPY_POOL_HPP
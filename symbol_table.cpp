@@ -0,0 +1,82 @@
+#include "symbol_table.hpp"
+#include "pool.hpp"
+
+const size_t symbol_table::linear_size;
+
+constexpr atom symbol_table::empty_key;
+
+symbol_table::symbol_table() { reset(); }
+
+symbol_table::symbol_table(const symbol_table &other) {
+    reset();
+    *this = other;
+}
+
+symbol_table::~symbol_table() { clear(); }
+
+symbol_table &symbol_table::operator=(const symbol_table &other) {
+    if (this == &other) return *this;
+
+    clear();
+    for (auto &e: other) {
+        insert(e.key, e.value);
+    }
+
+    return *this;
+}
+
+std::pair<symbol_table::entry *, bool> symbol_table::insert(atom key,
+                                                            lval *value) {
+    auto found = find(key);
+    if (found) return std::make_pair(found, false);
+
+    // Hashed tables are kept at most two thirds full, so probing stays short
+    // and always reaches an empty slot
+    if (hashed() ? (count + 1) * 3 > capacity * 2 : count == capacity) {
+        grow();
+    }
+
+    auto i = hashed() ? slot(key) : count;
+    while (entries[i].key != empty_key) i = (i + 1) & (capacity - 1);
+
+    entries[i] = {key, value};
+    count++;
+    return std::make_pair(entries + i, true);
+}
+
+void symbol_table::clear() {
+    if (hashed()) pool::deallocate(entries, capacity * sizeof(entry));
+    reset();
+}
+
+void symbol_table::reset() {
+    entries = inline_entries;
+    capacity = linear_size;
+    count = 0;
+
+    for (auto &e: inline_entries) {
+        e.key = empty_key;
+    }
+}
+
+void symbol_table::grow() {
+    auto old_entries = entries;
+    auto old_capacity = capacity;
+
+    capacity *= 2;
+    entries = static_cast<entry *>(pool::allocate(capacity * sizeof(entry)));
+    count = 0;
+    for (unsigned i = 0; i < capacity; i++) {
+        entries[i].key = empty_key;
+    }
+
+    for (unsigned i = 0; i < old_capacity; i++) {
+        if (old_entries[i].key != empty_key) {
+            insert(old_entries[i].key, old_entries[i].value);
+        }
+    }
+
+    if (old_entries != inline_entries) {
+        pool::deallocate(old_entries, old_capacity * sizeof(entry));
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef LISPY_SYMBOL_TABLE_HPP
+#define LISPY_SYMBOL_TABLE_HPP
+
+#include <cstddef>
+#include <utility>
+#include "atom.hpp"
+
+struct lval;
+
+// Bindings of an environment frame, keyed by atom.
+//
+// Function frames usually bind a handful of names, so up to linear_size
+// entries are kept inside the table in the order they were added and found
+// with a linear scan. The position of a binding in such a frame is its
+// slot. Bigger frames, like the global one, switch to an open addressing
+// hash table with linear probing over a pool block. Atom ids are small
+// consecutive integers, so multiplying by an odd constant spreads them over
+// the slots without hashing any characters.
+//
+// The table does not own the values, lenv does. Bindings are never removed
+// one by one, only all at once, so no tombstones are needed.
+class symbol_table {
+   public:
+    static const size_t linear_size = 4;
+
+    struct entry {
+        atom key;
+        lval *value;
+    };
+
+    class iterator {
+       public:
+        iterator(entry *pos, entry *end) : pos(pos), end(end) { skip(); }
+
+        entry &operator*() const { return *pos; }
+        entry *operator->() const { return pos; }
+
+        iterator &operator++() {
+            ++pos;
+            skip();
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const {
+            return pos == other.pos;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return pos != other.pos;
+        }
+
+       private:
+        entry *pos;
+        entry *end;
+
+        void skip() {
+            while (pos != end && pos->key == empty_key) ++pos;
+        }
+    };
+
+    symbol_table();
+    symbol_table(const symbol_table &other);
+    ~symbol_table();
+
+    symbol_table &operator=(const symbol_table &other);
+
+    iterator begin() const { return iterator(entries, entries + capacity); }
+    iterator end() const {
+        return iterator(entries + capacity, entries + capacity);
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Null if the key is not bound. Defined here because lookups run it on
+    // every frame of the scope chain
+    entry *find(atom key) const {
+        if (!hashed()) {
+            auto e = const_cast<entry *>(inline_entries);
+            for (auto end = e + count; e != end; ++e) {
+                if (e->key == key) return e;
+            }
+
+            return nullptr;
+        }
+
+        for (auto i = slot(key);; i = (i + 1) & (capacity - 1)) {
+            if (entries[i].key == key) return entries + i;
+            if (entries[i].key == empty_key) return nullptr;
+        }
+    }
+
+    // Entry in the given position of a table small enough to keep its
+    // bindings in order, null otherwise
+    entry *at(size_t slot) const {
+        if (hashed() || slot >= count) return nullptr;
+        return const_cast<entry *>(inline_entries + slot);
+    }
+
+    // Binds key to value, unless it is already bound. Returns the entry of
+    // key and whether it was added
+    std::pair<entry *, bool> insert(atom key, lval *value);
+
+    // Forgets every binding without touching the values
+    void clear();
+
+   private:
+    static constexpr atom empty_key = {~0u};
+
+    entry *entries;
+    unsigned capacity;
+    unsigned count;
+    entry inline_entries[linear_size];
+
+    bool hashed() const { return capacity > linear_size; }
+
+    size_t slot(atom key) const {
+        return (key.id * 2654435769u) & (capacity - 1);
+    }
+
+    void reset();
+    void grow();
+};
+
+#endif // LISPY_SYMBOL_TABLE_HPP
@@ -0,0 +1,1702 @@
+#include "vm.hpp"
+#include <sys/resource.h>
+#include <algorithm>
+#include "builtin.hpp"
+#include "gc.hpp"
+#include "lenv.hpp"
+#include "lval.hpp"
+#include "lval_error.hpp"
+#include "memo.hpp"
+
+using std::vector;
+
+namespace vm {
+
+enum intrinsic {
+    if_,
+    lambda,
+    macro,
+    eval,
+    add,
+    substract,
+    multiply,
+    equals,
+    not_equals,
+    less,
+    greater,
+    less_equal,
+    greater_equal,
+    do_,
+    let,
+    select,
+    case_,
+    and_,
+    or_,
+    intrinsic_count
+};
+
+const char *intrinsic_names[intrinsic_count] = {
+    "if", "\\", "\\!", "eval", "+",  "-",      "*",    "==",  "!=",
+    "<",  ">",  "<=",  ">=",   "do", "let", "select", "case", "and", "or"};
+
+// Builtin values found at startup, and the prelude functions and and or,
+// compared by identity. They are retained, so their addresses cannot be
+// reused once they are no longer bound
+const lval *intrinsics[intrinsic_count];
+
+// Builtins that only compute a value out of their arguments, see expansion.
+// if is not one of them, its branches may come from the arguments of a macro
+const char *pure_names[] = {"list", "head", "tail", "join", "cons", "len",
+                            "init", "==",   "!=",   ">",    "<",    ">=",
+                            "<=",   "+",    "-",    "*",    "/",    "%",
+                            "^",    "min",  "max"};
+
+const size_t pure_count = sizeof(pure_names) / sizeof(*pure_names);
+
+const lval *pure_builtins[pure_count];
+
+// Environment the builtins were found in, where compiled code looks up the
+// globals it folds
+lenv *global = nullptr;
+
+// Values being worked on by every run in progress, innermost on top
+thread_local vector<lval *> stack;
+
+// Frames owned by every run in progress, innermost on top
+thread_local vector<lenv *> frames;
+
+// Names bound by the frames visited so far, see push_frame
+thread_local vector<atom> seen;
+
+// Saved state of a call on the machine while a lambda it called runs
+struct activation {
+    chunk *code;
+    // Where to resume once the callee returns
+    size_t pc;
+    // Where its frames start in frames
+    size_t frames;
+    // Frame it was called from
+    lenv *outer;
+};
+
+// Calls of every run in progress waiting on a callee, innermost on top
+thread_local vector<activation> calls;
+
+thread_local settings local_config = {256 << 20};
+
+// Position on the native stack of the outermost evaluation seen so far, close
+// to the bottom of it. The stack grows down
+thread_local const char *native_base = nullptr;
+
+// Native stack evaluations nested by builtins may take, most of what the
+// process is allowed
+size_t native_budget() {
+    static const size_t budget = [] {
+        rlimit limit;
+        if (getrlimit(RLIMIT_STACK, &limit) != 0 ||
+            limit.rlim_cur == RLIM_INFINITY) {
+            return (size_t)64 << 20;
+        }
+
+        return (size_t)limit.rlim_cur / 4 * 3;
+    }();
+
+    return budget;
+}
+
+bool native_stack_exhausted() {
+    char marker;
+    if (!native_base || &marker > native_base) native_base = &marker;
+
+    return (size_t)(native_base - &marker) > native_budget();
+}
+
+void bind_intrinsics(const lenv *e) {
+    global = const_cast<lenv *>(e);
+
+    for (int i = 0; i < intrinsic_count; i++) {
+        auto v = e->lookup(atom::intern(intrinsic_names[i]));
+        if (intrinsics[i]) lval::release(const_cast<lval *>(intrinsics[i]));
+        // and and or are not there before the prelude
+        intrinsics[i] = v ? lval::copy(v) : nullptr;
+    }
+
+    for (size_t i = 0; i < pure_count; i++) {
+        auto v = e->lookup(atom::intern(pure_names[i]));
+        if (pure_builtins[i]) {
+            lval::release(const_cast<lval *>(pure_builtins[i]));
+        }
+        pure_builtins[i] = lval::copy(v);
+    }
+}
+
+void trace(const chunk *c, vector<lval *> &values) {
+    for (auto constant: c->constants) values.push_back(constant);
+    for (auto &assumed: c->assumptions) {
+        values.push_back(const_cast<lval *>(assumed.value));
+    }
+
+    for (auto &site: c->expansions) {
+        if (site.macro) values.push_back(site.macro);
+        if (site.result) values.push_back(site.result);
+    }
+
+    for (auto child: c->children) trace(child, values);
+}
+
+chunk::~chunk() {
+    for (auto node: nodes) lval::release(node);
+    for (auto constant: constants) lval::release(constant);
+    for (auto &assumed: assumptions) {
+        lval::release(const_cast<lval *>(assumed.value));
+    }
+    for (auto child: children) release(child);
+    for (auto &site: expansions) {
+        if (site.macro) lval::release(site.macro);
+        if (site.result) lval::release(site.result);
+    }
+}
+
+chunk *copy(const chunk *c) {
+    if (c) c->refs++;
+    return const_cast<chunk *>(c);
+}
+
+void release(chunk *c) {
+    if (c && --c->refs == 0) delete c;
+}
+
+bool is_pure_builtin(const lval *v) {
+    return std::find(pure_builtins, pure_builtins + pure_count, v) !=
+           pure_builtins + pure_count;
+}
+
+// Position of parameter name among the formals of lambda f, or -1 if it is
+// not one of them
+int formal_index(const lval *f, atom name) {
+    const auto &formals = f->lambda.formals->cells;
+    for (size_t i = 0; i < formals.size(); i++) {
+        if (formals[i]->sym.name == name) return i;
+    }
+
+    return -1;
+}
+
+// Global value symbol v names when compiling, or null if it names a
+// parameter or nothing. In the body of inlined, whose parameters are told
+// apart by name, since the same body may be resolved for other formals
+const lval *global_value(const lval *v, const lval *inlined = nullptr) {
+    if (!global || v->type != lval_type::symbol ||
+        v->sym.slot != lval::unresolved ||
+        (inlined && formal_index(inlined, v->sym.name) >= 0)) {
+        return nullptr;
+    }
+
+    return global->lookup(v->sym.name);
+}
+
+// Symbol and the global value it is assumed to have, see assumption
+using guess = std::pair<const lval *, const lval *>;
+
+// Operand of an instruction that still has to point to the end of a form
+using end_jump = std::pair<size_t, unsigned instruction::*>;
+
+struct compiler {
+    chunk *out;
+    // Off while compiling the code folded expressions and inlined calls fall
+    // back to, which only runs once a global they rely on changed
+    bool optimize = true;
+    // Function whose body is being inlined over the arguments of its call,
+    // or null
+    const lval *inlined = nullptr;
+    // Values pushed on top of the arguments so far
+    unsigned above = 0;
+
+    const lval *global_named(const lval *v) const {
+        return global_value(v, inlined);
+    }
+
+    unsigned node(const lval *v) {
+        out->nodes.push_back(lval::copy(v));
+        return out->nodes.size() - 1;
+    }
+
+    size_t emit(opcode op, unsigned a = 0, unsigned b = 0, unsigned c = 0) {
+        out->code.push_back({op, a, b, c});
+        return out->code.size() - 1;
+    }
+
+    unsigned here() const { return out->code.size(); }
+
+    // Emits the head instruction of call site v, jumping nowhere yet
+    size_t call_site(const lval *v) {
+        out->expansions.push_back({nullptr, nullptr, 0});
+        return emit(opcode::head, node(v), 0, out->expansions.size() - 1);
+    }
+
+    // Emits a guard on the globals in assumed, jumping nowhere yet
+    size_t guard_for(const vector<guess> &assumed) {
+        auto at = emit(opcode::guard, out->assumptions.size(), assumed.size());
+        for (auto &guess: assumed) {
+            out->assumptions.push_back(
+                {node(guess.first), lval::copy(guess.second)});
+        }
+
+        return at;
+    }
+
+    // Emits an instruction pushing v, which it takes over
+    void push_constant(lval *v) {
+        out->constants.push_back(v);
+        emit(opcode::constant, out->constants.size() - 1);
+    }
+
+    void expr(const lval *v);
+    void cell(const lval *v, bool tail);
+    void sexpr(const lval *v, bool tail);
+    void form(const lval *v, bool tail);
+    size_t arguments(const lval *v);
+    bool intrinsic_form(const lval *v, bool tail);
+    bool control_form(const lval *v, int which, bool tail);
+    void case_clauses(const lval *v, bool tail, vector<end_jump> &exits);
+    lval *constant(const lval *v, vector<guess> &assumed);
+    lval *applied(const lval *v, vector<guess> &assumed);
+    bool fold(const lval *v, bool tail);
+    const lval *inlinable(const lval *v, vector<guess> &assumed);
+    size_t inline_body(const lval *f);
+};
+
+int find_intrinsic(const lval *head) {
+    if (head->type != lval_type::symbol) return -1;
+
+    auto &name = head->sym.name.name();
+    for (int i = 0; i < intrinsic_count; i++) {
+        if (name == intrinsic_names[i]) return i;
+    }
+
+    return -1;
+}
+
+void compiler::expr(const lval *v) {
+    switch (v->type) {
+        case lval_type::symbol:
+        case lval_type::cname:
+            if (inlined) {
+                // Anything but a parameter is looked up from the caller, the
+                // frame of the call would not bind it anyway
+                int index = formal_index(inlined, v->sym.name);
+                if (index < 0) {
+                    emit(opcode::load_global, node(v));
+                } else {
+                    auto args = inlined->lambda.formals->cells.size();
+                    emit(opcode::load_arg, above + args - 1 - index);
+                }
+            } else if (v->sym.slot == lval::unresolved) {
+                emit(opcode::load_global, node(v));
+            } else {
+                emit(opcode::load_local, node(v));
+            }
+            break;
+        case lval_type::sexpr:
+            sexpr(v, false);
+            break;
+        default:
+            emit(opcode::push, node(v));
+            break;
+    }
+}
+
+// Compiles v to its value as a cell of an S-expression, the way the control
+// builtins evaluate the expressions they are given
+void compiler::cell(const lval *v, bool tail) {
+    if (v->type == lval_type::sexpr) {
+        sexpr(v, tail);
+    } else {
+        expr(v);
+    }
+}
+
+// Cells of v are evaluated as an S-expression, whatever its type. Its value
+// is the result of the whole body when tail is set
+void compiler::sexpr(const lval *v, bool tail) {
+    const auto &cells = v->cells;
+
+    if (cells.empty()) {
+        emit(opcode::empty);
+        return;
+    }
+
+    if (cells.size() == 1) {
+        expr(cells.front());
+        emit(opcode::single);
+        return;
+    }
+
+    if (optimize && fold(v, tail)) return;
+
+    form(v, tail);
+}
+
+// Compiles v, an S-expression with a callee and arguments, as it is
+void compiler::form(const lval *v, bool tail) {
+    const auto &cells = v->cells;
+
+    if (intrinsic_form(v, tail)) return;
+
+    vector<guess> assumed;
+    auto callee = optimize ? inlinable(v, assumed) : nullptr;
+    unsigned n = cells.size() - 1;
+
+    auto start = above;
+    expr(cells.front());
+    above++;
+    auto head = arguments(v);
+    above = start;
+
+    size_t skip = 0;
+    if (callee) {
+        out->constants.push_back(lval::copy(callee));
+        auto check = emit(opcode::inlined, out->constants.size() - 1, n);
+        auto guard = guard_for(assumed);
+        auto bailout = inline_body(callee);
+        emit(opcode::leave, n);
+        skip = emit(opcode::jump);
+        out->code[check].c = out->code[guard].c = here();
+        if (bailout) out->code[bailout].a = here();
+    }
+
+    emit(tail ? opcode::tail_call : opcode::call, n);
+    if (callee) out->code[skip].a = here();
+    out->code[head].b = here();
+}
+
+// Emits the head instruction of call site v, whose callee is on top, and
+// the code for its arguments. Returns the head instruction
+size_t compiler::arguments(const lval *v) {
+    const auto &cells = v->cells;
+    auto start = above;
+    auto head = call_site(v);
+    for (auto it = cells.begin() + 1; it != cells.end(); ++it) {
+        expr(*it);
+        above++;
+    }
+    above = start;
+    return head;
+}
+
+bool is_formals(const lval *v) {
+    if (v->type != lval_type::qexpr) return false;
+
+    for (auto cell: v->cells) {
+        if (cell->type != lval_type::symbol) return false;
+    }
+
+    return true;
+}
+
+// Compiles the forms of the builtins with an opcode of their own, returning
+// false if v is not one of them
+bool compiler::intrinsic_form(const lval *v, bool tail) {
+    const auto &cells = v->cells;
+    auto which = find_intrinsic(cells.front());
+    if (which < 0) return false;
+
+    switch (which) {
+        case if_: {
+            if (cells.size() != 4 || cells[2]->type != lval_type::qexpr ||
+                cells[3]->type != lval_type::qexpr) {
+                return false;
+            }
+
+            auto start = above;
+            expr(cells[0]);
+            above++;
+            auto head = call_site(v);
+            expr(cells[1]);
+            above = start;
+            auto branch = emit(opcode::branch, node(v));
+            sexpr(cells[2], tail);
+            auto skip = emit(opcode::jump);
+            out->code[branch].b = here();
+            sexpr(cells[3], tail);
+            out->code[head].b = out->code[branch].c = out->code[skip].a =
+                here();
+            return true;
+        }
+        case lambda:
+        case macro: {
+            if (cells.size() != 3 || !is_formals(cells[1]) ||
+                cells[2]->type != lval_type::qexpr) {
+                return false;
+            }
+
+            // The body was resolved along with the one it is written in,
+            // see builtin::resolve, so the lambda needs nothing more
+            out->children.push_back(compile(cells[2]));
+
+            auto start = above;
+            expr(cells[0]);
+            above++;
+            auto head = call_site(v);
+            expr(cells[1]);
+            above++;
+            expr(cells[2]);
+            above = start;
+            emit(opcode::closure, which, out->children.size() - 1);
+            out->code[head].b = here();
+            return true;
+        }
+        case eval:
+            return false;
+        case do_:
+        case let:
+        case select:
+        case case_:
+        case and_:
+        case or_:
+            return control_form(v, which, tail);
+        default: {
+            if (cells.size() != 3) return false;
+
+            auto start = above;
+            expr(cells[0]);
+            above++;
+            auto head = call_site(v);
+            expr(cells[1]);
+            above++;
+            expr(cells[2]);
+            above = start;
+            emit(opcode::arith, which);
+            out->code[head].b = here();
+            return true;
+        }
+    }
+}
+
+// Whether v is a clause of select or case, see builtin::select
+bool is_clause(const lval *v) {
+    return v->type == lval_type::qexpr && v->cells.size() == 2;
+}
+
+bool is_literal_key(const lval *v) {
+    switch (v->type) {
+        case lval_type::integer:
+        case lval_type::decimal:
+        case lval_type::string:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Whether the arguments of S-expression v are what control form which
+// expects, so the form can be compiled in place
+bool control_shape(const lval *v, int which) {
+    const auto &cells = v->cells;
+    switch (which) {
+        case let:
+            return cells.size() == 2 && cells[1]->type == lval_type::qexpr;
+        case select:
+        case case_:
+            return std::all_of(
+                cells.begin() + (which == select ? 1 : 2), cells.end(),
+                [](auto clause) { return is_clause(clause); });
+        case and_:
+        case or_:
+            return cells.size() == 3;
+        default:
+            return true;
+    }
+}
+
+// Compiles a call to control form which in place, leaving the regular
+// call for when the callee turns out to be something else
+bool compiler::control_form(const lval *v, int which, bool tail) {
+    if (!control_shape(v, which)) return false;
+
+    const auto &cells = v->cells;
+    vector<end_jump> exits;
+    auto to_end = [&](opcode op) {
+        exits.push_back({emit(op), &instruction::a});
+    };
+
+    auto start = above;
+    expr(cells.front());
+    auto check = emit(opcode::control, which);
+
+    switch (which) {
+        case do_: {
+            // Every argument is evaluated, the last one in tail position
+            // unless an earlier one failed
+            auto last = cells.size() - 1;
+            for (size_t i = 1; i < last; i++) {
+                expr(cells[i]);
+                above++;
+            }
+            above = start;
+
+            size_t drop = 0;
+            if (last > 1) drop = emit(opcode::drop, last - 1);
+            cell(cells[last], tail);
+            to_end(opcode::jump);
+
+            if (drop) {
+                out->code[drop].b = here();
+                expr(cells[last]);
+                emit(opcode::pop);
+                to_end(opcode::jump);
+            }
+            break;
+        }
+        case let:
+            out->children.push_back(compile(cells[1]));
+            emit(opcode::scope, out->children.size() - 1, tail);
+            to_end(opcode::jump);
+            break;
+        case select:
+            for (auto it = cells.begin() + 1; it != cells.end(); ++it) {
+                cell((*it)->cells.front(), false);
+                auto test = emit(opcode::test, 0, 0, which);
+                exits.push_back({test, &instruction::b});
+                cell((*it)->cells[1], tail);
+                to_end(opcode::jump);
+                out->code[test].a = here();
+            }
+            push_constant(lval::error(lerr::no_selection_found()));
+            to_end(opcode::jump);
+            break;
+        case case_:
+            case_clauses(v, tail, exits);
+            break;
+        default: {
+            // The second operand of and is only evaluated when the first
+            // one holds, the one of or when it does not. A first operand
+            // that is not a boolean fails the way the if of their prelude
+            // definitions does
+            cell(cells[1], false);
+            auto test = emit(opcode::test, 0, 0, if_);
+            exits.push_back({test, &instruction::b});
+            if (which == and_) {
+                cell(cells[2], tail);
+            } else {
+                push_constant(lval::make(true));
+            }
+            to_end(opcode::jump);
+
+            out->code[test].a = here();
+            if (which == and_) {
+                push_constant(lval::make(false));
+            } else {
+                cell(cells[2], tail);
+            }
+            to_end(opcode::jump);
+            break;
+        }
+    }
+
+    out->code[check].b = here();
+    above++;
+    auto head = arguments(v);
+    above = start;
+    emit(tail ? opcode::tail_call : opcode::call, cells.size() - 1);
+
+    out->code[head].b = here();
+    for (auto &exit: exits) out->code[exit.first].*exit.second = here();
+    return true;
+}
+
+// Compiles the clauses of case form v, with the key to match on top. When
+// every key is a literal the clause is found through a jump table,
+// otherwise the keys are evaluated and compared in turn
+void compiler::case_clauses(const lval *v, bool tail,
+                            vector<end_jump> &exits) {
+    const auto &cells = v->cells;
+    bool literal = std::all_of(cells.begin() + 2, cells.end(), [](auto clause) {
+        return is_literal_key(clause->cells.front());
+    });
+
+    auto start = above;
+    expr(cells[1]);
+    above++;
+
+    auto table = out->tables.size();
+    out->tables.emplace_back();
+    auto dispatch = emit(opcode::dispatch, table, 0);
+    out->code[dispatch].b = here();
+    exits.push_back({dispatch, &instruction::c});
+
+    for (auto it = cells.begin() + 2; it != cells.end(); ++it) {
+        auto key = (*it)->cells.front();
+        size_t match = 0;
+
+        if (literal) {
+            auto h = memo::hash(key);
+            auto range = out->tables[table].equal_range(h);
+            bool repeated =
+                std::any_of(range.first, range.second, [&](auto &target) {
+                    return *out->nodes[target.second.key] == *key;
+                });
+            if (repeated) continue;
+
+            out->tables[table].insert({h, {node(key), here()}});
+        } else {
+            cell(key, false);
+            match = emit(opcode::match);
+            exits.push_back({match, &instruction::b});
+        }
+
+        emit(opcode::pop);
+        above = start;
+        cell((*it)->cells[1], tail);
+        above = start + 1;
+        exits.push_back({emit(opcode::jump), &instruction::a});
+
+        if (!literal) out->code[match].a = here();
+    }
+
+    if (literal) out->code[dispatch].b = here();
+    emit(opcode::pop);
+    above = start;
+    push_constant(lval::error(lerr::no_case_found()));
+    exits.push_back({emit(opcode::jump), &instruction::a});
+}
+
+// Value expression v always has while the globals in assumed keep theirs, or
+// null if it is not known. Only literals, global data and pure builtins
+// applied to them without failing are
+lval *compiler::constant(const lval *v, vector<guess> &assumed) {
+    switch (v->type) {
+        case lval_type::symbol: {
+            auto x = global_named(v);
+            if (!x) return nullptr;
+
+            switch (x->type) {
+                case lval_type::func:
+                case lval_type::macro:
+                case lval_type::command:
+                case lval_type::error:
+                    return nullptr;
+                default:
+                    assumed.push_back({v, x});
+                    return lval::copy(x);
+            }
+        }
+        case lval_type::sexpr:
+            return applied(v, assumed);
+        case lval_type::cname:
+            return nullptr;
+        default:
+            return lval::copy(v);
+    }
+}
+
+// Same as constant, for the cells of v evaluated as an S-expression with a
+// callee and arguments
+lval *compiler::applied(const lval *v, vector<guess> &assumed) {
+    const auto &cells = v->cells;
+    if (cells.size() < 2) return nullptr;
+
+    auto f = global_named(cells.front());
+    if (!f || !is_pure_builtin(f)) return nullptr;
+
+    auto args = lval::sexpr();
+    for (auto it = cells.begin() + 1; it != cells.end(); ++it) {
+        auto x = constant(*it, assumed);
+        if (!x) {
+            lval::release(args);
+            return nullptr;
+        }
+
+        args->cells.push_back(x);
+    }
+
+    auto result = const_cast<lval *>(f)->call(global, args);
+    if (result->type == lval_type::error) {
+        lval::release(result);
+        return nullptr;
+    }
+
+    assumed.push_back({cells.front(), f});
+    return result;
+}
+
+// Compiles the cells of v to their value, or to the branch it takes if it is
+// an if, when that is known already. The code is guarded by the globals it
+// was found with and falls back to the code for v as it is. Returns false,
+// compiling nothing, when nothing is known
+bool compiler::fold(const lval *v, bool tail) {
+    vector<guess> assumed;
+    auto value = applied(v, assumed);
+    const lval *taken = nullptr;
+
+    if (!value) {
+        const auto &cells = v->cells;
+        if (find_intrinsic(cells.front()) != if_ || cells.size() != 4 ||
+            cells[2]->type != lval_type::qexpr ||
+            cells[3]->type != lval_type::qexpr ||
+            global_named(cells.front()) != intrinsics[if_]) {
+            return false;
+        }
+
+        assumed.clear();
+        auto cond = constant(cells[1], assumed);
+        if (!cond) return false;
+
+        if (cond->type == lval_type::boolean) {
+            taken = cond->boolean ? cells[2] : cells[3];
+        }
+        lval::release(cond);
+        if (!taken) return false;
+
+        assumed.push_back({cells.front(), intrinsics[if_]});
+    }
+
+    auto guard = guard_for(assumed);
+
+    if (value) {
+        push_constant(value);
+    } else {
+        sexpr(taken, tail);
+    }
+
+    auto skip = emit(opcode::jump);
+    out->code[guard].c = here();
+    optimize = false;
+    form(v, tail);
+    optimize = true;
+    out->code[skip].a = here();
+    return true;
+}
+
+// Nodes a body may have to be inlined
+const size_t inline_budget = 32;
+
+const atom variadic_sym = atom::intern("&");
+
+bool inlinable_call(const lval *v, const lval *f, vector<guess> &assumed,
+                    size_t &budget, bool root);
+
+// Whether argument v of a call in the body of f can be evaluated without
+// the frame of the call. Symbols other than the parameters of f are looked
+// up from the caller, and calls may only go to pure builtins, which do not
+// look at the environment
+bool inlinable_arg(const lval *v, const lval *f, vector<guess> &assumed,
+                   size_t &budget) {
+    if (budget-- == 0) return false;
+
+    switch (v->type) {
+        case lval_type::symbol:
+            return true;
+        case lval_type::cname:
+            return false;
+        case lval_type::sexpr:
+            return inlinable_call(v, f, assumed, budget, false);
+        default:
+            return true;
+    }
+}
+
+// Same as inlinable_arg, for the cells of v evaluated as an S-expression.
+// eval is only allowed at the root of the body, where nothing runs after it
+bool inlinable_call(const lval *v, const lval *f, vector<guess> &assumed,
+                    size_t &budget, bool root) {
+    const auto &cells = v->cells;
+
+    if (cells.empty()) return true;
+
+    // A single value is called if it is a command, which would get the
+    // environment
+    if (cells.size() == 1) {
+        auto x = cells.front();
+        return x->type != lval_type::symbol && x->type != lval_type::cname &&
+               inlinable_arg(x, f, assumed, budget);
+    }
+
+    auto callee = global_value(cells.front(), f);
+    if (!callee) return false;
+
+    if (callee == intrinsics[if_]) {
+        if (cells.size() != 4 || cells[2]->type != lval_type::qexpr ||
+            cells[3]->type != lval_type::qexpr) {
+            return false;
+        }
+
+        assumed.push_back({cells.front(), callee});
+        return inlinable_arg(cells[1], f, assumed, budget) &&
+               inlinable_call(cells[2], f, assumed, budget, false) &&
+               inlinable_call(cells[3], f, assumed, budget, false);
+    }
+
+    if (callee == intrinsics[eval] ? !root || cells.size() != 2
+                                   : !is_pure_builtin(callee)) {
+        return false;
+    }
+
+    assumed.push_back({cells.front(), callee});
+    for (auto it = cells.begin() + 1; it != cells.end(); ++it) {
+        if (!inlinable_arg(*it, f, assumed, budget)) return false;
+    }
+
+    return true;
+}
+
+// Global function called by S-expression v if its body can be compiled in
+// place of the call, adding the builtins the body relies on to assumed, or
+// null. The function has to take exactly the arguments given, so the call
+// binds them all
+const lval *compiler::inlinable(const lval *v, vector<guess> &assumed) {
+    auto f = global_value(v->cells.front());
+    if (!f || f->type != lval_type::func || f->has_builtin ||
+        f->lambda.bound) {
+        return nullptr;
+    }
+
+    const auto &formals = f->lambda.formals->cells;
+    if (formals.size() != v->cells.size() - 1) return nullptr;
+
+    // Parameters are told apart by name in the inlined body, see expr
+    for (size_t i = 0; i < formals.size(); i++) {
+        auto name = formals[i]->sym.name;
+        if (name == variadic_sym || formal_index(f, name) != (int)i) {
+            return nullptr;
+        }
+    }
+
+    size_t budget = inline_budget;
+    if (!inlinable_call(f->lambda.body, f, assumed, budget, true)) {
+        return nullptr;
+    }
+
+    return f;
+}
+
+// Compiles the body of f over the arguments of the call on top. Returns the
+// eval_inlined instruction that may have to fall back, or 0 if there is none
+size_t compiler::inline_body(const lval *f) {
+    auto saved_inlined = inlined;
+    auto saved_above = above;
+    inlined = f;
+    above = 0;
+
+    size_t bailout = 0;
+    auto body = f->lambda.body;
+    const auto &cells = body->cells;
+    if (cells.size() == 2 && global_named(cells.front()) == intrinsics[eval]) {
+        expr(cells[1]);
+        bailout = emit(opcode::eval_inlined);
+    } else {
+        sexpr(body, false);
+    }
+
+    inlined = saved_inlined;
+    above = saved_above;
+    return bailout;
+}
+
+chunk *compile(const lval *body) {
+    compiler c = {new chunk()};
+    c.sexpr(body, true);
+    return c.out;
+}
+
+lval *found(const lval *x, const lval::symbol_type &sym) {
+    return x ? lval::copy(x) : lval::error(lerr::unknown_sym(sym.name.name()));
+}
+
+// Calls the function below the n values on top, which replaces them all with
+// the result
+void call(lenv *e, size_t n) {
+    auto base = stack.size() - n;
+    auto f = stack[base - 1];
+
+    lval *result = nullptr;
+    for (auto i = base; i < stack.size(); i++) {
+        if (stack[i]->type == lval_type::error) {
+            result = lval::copy(stack[i]);
+            break;
+        }
+    }
+
+    if (result) {
+        for (auto i = base; i < stack.size(); i++) lval::release(stack[i]);
+    } else {
+        auto args = lval::sexpr();
+        for (auto i = base; i < stack.size(); i++) {
+            args->cells.push_back(stack[i]);
+        }
+
+        result = f->call(e, args);
+    }
+
+    stack.resize(base);
+    lval::release(f);
+    stack.back() = result;
+}
+
+lval *integer_op(int which, long x, long y) {
+    switch (which) {
+        case add:
+            return lval::make(x + y);
+        case substract:
+            return lval::make(x - y);
+        case multiply:
+            return lval::make(x * y);
+        case equals:
+            return lval::make(x == y);
+        case not_equals:
+            return lval::make(x != y);
+        case less:
+            return lval::make(x < y);
+        case greater:
+            return lval::make(x > y);
+        case less_equal:
+            return lval::make(x <= y);
+        default:
+            return lval::make(x >= y);
+    }
+}
+
+void arith(lenv *e, int which) {
+    auto size = stack.size();
+    auto f = stack[size - 3];
+    auto x = stack[size - 2];
+    auto y = stack[size - 1];
+
+    if (f != intrinsics[which] || x->type != lval_type::integer ||
+        y->type != lval_type::integer) {
+        call(e, 2);
+        return;
+    }
+
+    auto result = integer_op(which, x->integ, y->integ);
+    lval::release(x);
+    lval::release(y);
+    lval::release(f);
+    stack.resize(size - 2);
+    stack.back() = result;
+}
+
+void closure(lenv *e, int which, const chunk *code) {
+    auto size = stack.size();
+    auto f = stack[size - 3];
+
+    if (f != intrinsics[which]) {
+        call(e, 2);
+        return;
+    }
+
+    auto formals = stack[size - 2];
+    auto body = stack[size - 1];
+    lval::release(f);
+    stack.resize(size - 2);
+    auto v = which == lambda ? lval::function(formals, body)
+                             : lval::macro(formals, body);
+    v->lambda.code = copy(code);
+    stack.back() = v;
+}
+
+// Pops the condition of an if, returning where to go on: next if it holds,
+// in.b if it does not. Anything else leaves the result of the whole
+// expression in place of the callee and goes to in.c
+size_t branch(lenv *e, const instruction &in, const lval *node, size_t next) {
+    auto cond = stack.back();
+    auto f = stack[stack.size() - 2];
+
+    if (f != intrinsics[if_]) {
+        stack.push_back(lval::copy(node->cells[2]));
+        stack.push_back(lval::copy(node->cells[3]));
+        call(e, 3);
+        return in.c;
+    }
+
+    stack.pop_back();
+    lval::release(f);
+
+    if (cond->type == lval_type::error) {
+        stack.back() = cond;
+        return in.c;
+    }
+
+    if (cond->type != lval_type::boolean) {
+        stack.back() = lval::error(lerr::passed_incorrect_type(
+            "if", cond->type, lval_type::boolean));
+        lval::release(cond);
+        return in.c;
+    }
+
+    stack.pop_back();
+    bool holds = cond->boolean;
+    lval::release(cond);
+    return holds ? next : in.b;
+}
+
+lval *short_circuit(lenv *e, const lval *f, const lval *v) {
+    if (v->cells.size() != 3) return nullptr;
+    if (f != intrinsics[and_] && f != intrinsics[or_]) return nullptr;
+
+    auto x = lval::evaluate(e, v->cells[1]);
+    if (x->type == lval_type::error) return x;
+
+    if (x->type != lval_type::boolean) {
+        auto err = lval::error(
+            lerr::passed_incorrect_type("if", x->type, lval_type::boolean));
+        lval::release(x);
+        return err;
+    }
+
+    if (x->boolean == (f == intrinsics[or_])) return x;
+
+    lval::release(x);
+    return lval::evaluate(e, v->cells[2]);
+}
+
+// Pops the condition of a select, and or or, returning where to go on: next
+// if it holds, in.a if it does not. Anything else leaves the result of the
+// whole expression in its place and goes to in.b
+size_t test(const instruction &in, size_t next) {
+    auto cond = stack.back();
+
+    if (cond->type == lval_type::boolean) {
+        stack.pop_back();
+        bool holds = cond->boolean;
+        lval::release(cond);
+        return holds ? next : in.a;
+    }
+
+    if (cond->type != lval_type::error) {
+        stack.back() = lval::error(lerr::passed_incorrect_type(
+            intrinsic_names[in.c], cond->type, lval_type::boolean));
+        lval::release(cond);
+    }
+
+    return in.b;
+}
+
+// Where a case goes on with the key on top, see opcode::dispatch
+size_t dispatch(const chunk &c, const instruction &in) {
+    auto x = stack.back();
+    if (x->type == lval_type::error) return in.c;
+
+    const auto &table = c.tables[in.a];
+    if (table.empty()) return in.b;
+
+    auto range = table.equal_range(memo::hash(x));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (*x == *c.nodes[it->second.key]) return it->second.target;
+    }
+
+    return in.b;
+}
+
+// Pops the key of a case clause, returning where to go on: next if it
+// equals the value below, in.a if it does not. An error is left as the
+// result of the case and goes to in.b
+size_t match(const instruction &in, size_t next) {
+    auto key = stack.back();
+    stack.pop_back();
+    auto x = stack.back();
+
+    if (key->type == lval_type::error) {
+        lval::release(x);
+        stack.back() = key;
+        return in.b;
+    }
+
+    bool equal = *x == *key;
+    lval::release(key);
+    return equal ? next : in.a;
+}
+
+// Drops the n values on top, leaving the first error among them instead if
+// there is one. Returns whether there was
+bool drop(size_t n) {
+    auto base = stack.size() - n;
+    lval *failed = nullptr;
+    for (auto i = base; i < stack.size(); i++) {
+        if (!failed && stack[i]->type == lval_type::error) {
+            failed = stack[i];
+        } else {
+            lval::release(stack[i]);
+        }
+    }
+
+    stack.resize(base);
+    if (failed) stack.push_back(failed);
+    return failed;
+}
+
+// Whether the call to the function below the n arguments on top can run the
+// body of f inlined instead
+bool inlines(const lval *f, size_t n) {
+    auto base = stack.size() - n;
+    return stack[base - 1] == f &&
+           std::none_of(stack.begin() + base, stack.end(), [](auto v) {
+               return v->type == lval_type::error;
+           });
+}
+
+// Evaluates the Q-Expression on top the way eval would in an inlined body,
+// as long as that needs no frame. Otherwise pops it and returns false
+bool eval_inlined() {
+    auto x = stack.back();
+
+    if (x->type == lval_type::error) return true;
+
+    if (x->type == lval_type::qexpr && x->cells.size() == 1) {
+        auto cell = x->cells.front();
+        switch (cell->type) {
+            case lval_type::symbol:
+            case lval_type::cname:
+            case lval_type::sexpr:
+            case lval_type::command:
+                break;
+            default:
+                stack.back() = lval::copy(cell);
+                lval::release(x);
+                return true;
+        }
+    }
+
+    lval::release(x);
+    stack.pop_back();
+    return false;
+}
+
+// Replaces the inlined call with n arguments below the result on top with
+// the result
+void leave(size_t n) {
+    auto result = stack.back();
+    auto base = stack.size() - 2 - n;
+    for (auto i = base; i < stack.size() - 1; i++) lval::release(stack[i]);
+    stack.resize(base + 1);
+    stack.back() = result;
+}
+
+// Whether the globals the code after guard in was folded with still have the
+// values it assumes, as seen from e
+bool still_holds(lenv *e, const chunk &c, const instruction &in) {
+    for (auto i = in.a; i < in.a + in.b; i++) {
+        auto &assumed = c.assumptions[i];
+        auto &sym = c.nodes[assumed.node]->sym;
+        if (lval::lookup_global(e, sym) != assumed.value) return false;
+    }
+
+    return true;
+}
+
+// Whether the evaluation stacks are full, in which case the call that was
+// about to run next in frame fails instead
+bool exhausted(lenv *frame, chunk *next) {
+    auto used = calls.size() * sizeof(activation) +
+                stack.size() * sizeof(lval *) +
+                frames.size() * (sizeof(lenv *) + sizeof(lenv));
+    if (used < local_config.max_stack) return false;
+
+    lenv::release(frame);
+    release(next);
+    stack.push_back(lval::error(lerr::stack_exhausted()));
+    return true;
+}
+
+// Expression a call to the builtin eval or if with the n arguments on top
+// goes on to evaluate, or null if the call would fail
+const lval *tail_expr(const lval *f, size_t n) {
+    auto args = &stack[stack.size() - n];
+
+    if (f == intrinsics[eval]) {
+        return n == 1 && args[0]->type == lval_type::qexpr ? args[0] : nullptr;
+    }
+
+    if (f != intrinsics[if_] || n != 3 ||
+        args[0]->type != lval_type::boolean ||
+        args[1]->type != lval_type::qexpr ||
+        args[2]->type != lval_type::qexpr) {
+        return nullptr;
+    }
+
+    return args[0]->boolean ? args[1] : args[2];
+}
+
+// Replaces the call to eval or if below the n arguments on top with the
+// call in the expression it evaluates, when that one calls a lambda and
+// looking its callee up has no side effects. Returns the number of
+// arguments now on top, or 0 if nothing was replaced
+size_t unwrap(lenv *e, size_t n) {
+    auto base = stack.size() - n;
+    auto x = tail_expr(stack[base - 1], n);
+    if (!x || x->cells.size() < 2) return 0;
+
+    auto head = x->cells.front();
+    const lval *callee = head;
+    if (head->type == lval_type::symbol || head->type == lval_type::cname) {
+        callee = lval::lookup(e, head->sym);
+    } else if (head->type == lval_type::sexpr) {
+        callee = nullptr;
+    }
+
+    if (!callee || callee->type != lval_type::func || callee->has_builtin) {
+        return 0;
+    }
+
+    size_t given = x->cells.size() - 1;
+    stack.push_back(lval::copy(callee));
+    for (auto it = x->cells.begin() + 1; it != x->cells.end(); ++it) {
+        stack.push_back(lval::evaluate(e, *it));
+    }
+
+    // The evaluated call takes the place of the original one, which holds x
+    for (auto i = base - 1; i < base + n; i++) lval::release(stack[i]);
+    stack.erase(stack.begin() + (base - 1), stack.begin() + (base + n));
+
+    return given;
+}
+
+void add_symbols(const lval *v, vector<const lval *> &symbols) {
+    for (auto cell: v->cells) {
+        switch (cell->type) {
+            case lval_type::symbol:
+            case lval_type::cname:
+                symbols.push_back(cell);
+                break;
+            case lval_type::sexpr:
+            case lval_type::qexpr:
+                add_symbols(cell, symbols);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Whether a call to macro f binds name in its own frame
+bool binds(const lval *f, atom name) {
+    for (auto formal: f->lambda.formals->cells) {
+        if (formal->sym.name == name) return true;
+    }
+
+    return false;
+}
+
+// Finds whether the body of macro f, called from e, only refers to its own
+// arguments, to data and to pure builtins, adding the globals it refers to
+// to globals
+purity analyse(lenv *e, const lval *f, vector<atom> &globals) {
+    vector<const lval *> symbols;
+    add_symbols(f->lambda.body, symbols);
+
+    for (auto sym: symbols) {
+        auto name = sym->sym.name;
+        if (sym->type != lval_type::symbol) return purity::impure;
+        if (binds(f, name)) continue;
+        if (lenv::bound_locally(name)) return purity::impure;
+
+        auto v = e->lookup(name);
+        if (!v) return purity::impure;
+
+        switch (v->type) {
+            case lval_type::func:
+            case lval_type::macro:
+            case lval_type::command:
+                if (!is_pure_builtin(v)) return purity::impure;
+                break;
+            default:
+                break;
+        }
+
+        if (std::find(globals.begin(), globals.end(), name) == globals.end()) {
+            globals.push_back(name);
+        }
+    }
+
+    return purity::pure;
+}
+
+bool is_pure(lenv *e, const lval *f) {
+    auto code = f->lambda.code;
+    auto version = lenv::version();
+    if (code->body_purity == purity::unknown ||
+        code->purity_version != version) {
+        code->globals.clear();
+        code->body_purity = analyse(e, f, code->globals);
+        code->purity_version = version;
+    }
+
+    return code->body_purity == purity::pure;
+}
+
+// Whether a local frame binds one of the globals the body of macro f
+// depends on, so its result there is not the one it gives elsewhere
+bool shadowed(const lval *f) {
+    for (auto name: f->lambda.code->globals) {
+        if (lenv::bound_locally(name)) return true;
+    }
+
+    return false;
+}
+
+// Whether the result kept at site is still the one macro f gives there
+bool holds(const expansion &site, const lval *f) {
+    return site.macro == f && site.version == lenv::version() &&
+           !shadowed(f);
+}
+
+// Calls macro f, on top, with the cells of call site node as arguments.
+// When the machine has to run its body, returns the frame to run it in with
+// the code in next. Otherwise puts the result in place of f and returns null
+lenv *expand(lenv *e, const lval *node, expansion &site, chunk *&next) {
+    auto f = stack.back();
+    lval *result;
+
+    if (holds(site, f)) {
+        result = lval::copy(site.result);
+    } else {
+        const auto &cells = node->cells;
+        auto args = lval::qexpr();
+        for (auto it = cells.begin() + 1; it != cells.end(); ++it) {
+            args->cells.push_back(lval::copy(*it));
+        }
+
+        if (f->has_builtin) {
+            result = f->call(e, args);
+        } else if (is_pure(e, f)) {
+            result = f->call(e, args);
+
+            if (!shadowed(f)) {
+                if (site.macro) lval::release(site.macro);
+                if (site.result) lval::release(site.result);
+                site = {lval::copy(f), lval::copy(result), lenv::version()};
+            }
+        } else {
+            auto frame = f->bind(e, args, result);
+            if (frame) {
+                next = copy(f->lambda.code);
+                lval::release(f);
+                stack.pop_back();
+                return frame;
+            }
+        }
+    }
+
+    lval::release(f);
+    stack.back() = result;
+    return nullptr;
+}
+
+// Makes frame, the one of a function called in tail position, the innermost
+// of the run whose frames start at base. Its parent would be the frame of
+// the caller, and so on back to outer, the frame the run was called from.
+// Nothing but this chain sees the earlier frames of the run anymore, so the
+// ones whose names are all bound closer to frame are dropped instead of
+// piling up on every iteration
+void push_frame(lenv *frame, size_t base, lenv *outer) {
+    seen.clear();
+    for (auto &entry: frame->symbols) seen.push_back(entry.key);
+
+    auto child = frame;
+    for (auto i = frames.size(); i-- > base;) {
+        auto f = frames[i];
+        bool needed = false;
+        for (auto &entry: f->symbols) {
+            if (std::find(seen.begin(), seen.end(), entry.key) == seen.end()) {
+                seen.push_back(entry.key);
+                needed = true;
+            }
+        }
+
+        if (!needed) {
+            lenv::release(f);
+            frames[i] = nullptr;
+            continue;
+        }
+
+        child->parent = f;
+        child = f;
+    }
+
+    child->parent = outer;
+    frames.erase(std::remove(frames.begin() + base, frames.end(), nullptr),
+                 frames.end());
+    frames.push_back(frame);
+}
+
+// Calls the function below the n arguments on top. If it is a lambda, only
+// binds the arguments and returns the new frame, with the code to run in it
+// in next, leaving the rest to the machine. Otherwise makes the call right
+// away and returns null
+lenv *enter(lenv *e, size_t n, chunk *&next) {
+    if (auto unwrapped = unwrap(e, n)) n = unwrapped;
+
+    auto base = stack.size() - n;
+    auto f = stack[base - 1];
+    bool failed = std::any_of(stack.begin() + base, stack.end(), [](auto v) {
+        return v->type == lval_type::error;
+    });
+
+    if (f->type != lval_type::func || f->has_builtin || failed) {
+        call(e, n);
+        return nullptr;
+    }
+
+    // The arguments are bound straight from the stack
+    lval *result;
+    auto frame = f->bind(e, &stack[base], n, result);
+    for (auto i = base; i < stack.size(); i++) lval::release(stack[i]);
+    stack.resize(base);
+
+    if (!frame) {
+        lval::release(f);
+        stack.back() = result;
+        return nullptr;
+    }
+
+    next = copy(f->lambda.code);
+
+    lval::release(f);
+    stack.pop_back();
+    return frame;
+}
+
+lval *run(lenv *e, const chunk *c) {
+    // Runs only nest through builtins that evaluate
+    if (native_stack_exhausted()) {
+        lenv::release(e);
+        return lval::error(lerr::stack_exhausted());
+    }
+
+    gc::eval_scope scope;
+
+    // State of the call being run. Calls it makes to lambdas save it in
+    // calls and run in the same loop, it is restored when they return
+    auto bottom = calls.size();
+    auto outer = e->parent;
+    auto base = frames.size();
+    auto current = copy(c);
+    size_t pc = 0;
+    frames.push_back(e);
+
+    // Makes the current call go on with next in frame, which is called from
+    // e, and resume at resume once it returns
+    auto call_into = [&](lenv *frame, chunk *next, size_t resume) {
+        if (exhausted(frame, next)) {
+            pc = resume;
+            return;
+        }
+
+        calls.push_back({current, resume, base, outer});
+        frame->parent = e;
+        outer = e;
+        base = frames.size();
+        frames.push_back(frame);
+        current = next;
+        pc = 0;
+        e = frame;
+    };
+
+    while (true) {
+        if (pc == current->code.size()) {
+            for (auto i = base; i < frames.size(); i++) {
+                lenv::release(frames[i]);
+            }
+            frames.resize(base);
+            release(current);
+
+            if (calls.size() == bottom) break;
+
+            auto &caller = calls.back();
+            current = caller.code;
+            pc = caller.pc;
+            base = caller.frames;
+            outer = caller.outer;
+            calls.pop_back();
+            e = frames.back();
+            continue;
+        }
+
+        const auto &nodes = current->nodes;
+        const auto &in = current->code[pc++];
+
+        switch (in.op) {
+            case opcode::push:
+                stack.push_back(lval::copy(nodes[in.a]));
+                break;
+
+            case opcode::constant:
+                stack.push_back(lval::copy(current->constants[in.a]));
+                break;
+
+            case opcode::empty:
+                stack.push_back(lval::sexpr());
+                break;
+
+            case opcode::load_local: {
+                auto &sym = nodes[in.a]->sym;
+                auto x = e->lookup(sym.name, sym.depth, sym.slot);
+                stack.push_back(found(x, sym));
+                break;
+            }
+
+            case opcode::load_global: {
+                auto &sym = nodes[in.a]->sym;
+                stack.push_back(found(lval::lookup_global(e, sym), sym));
+                break;
+            }
+
+            case opcode::single: {
+                auto val = stack.back();
+                if (val->type == lval_type::command) {
+                    auto result = val->call(e, lval::sexpr());
+                    lval::release(val);
+                    stack.back() = result;
+                }
+                break;
+            }
+
+            case opcode::head: {
+                auto f = stack.back();
+                switch (f->type) {
+                    case lval_type::func: {
+                        // and and or called through a variable
+                        auto result = short_circuit(e, f, nodes[in.a]);
+                        if (result) {
+                            lval::release(f);
+                            stack.back() = result;
+                            pc = in.b;
+                        }
+                        break;
+                    }
+                    case lval_type::error:
+                        pc = in.b;
+                        break;
+                    case lval_type::macro:
+                    case lval_type::command: {
+                        chunk *next;
+                        auto &site = current->expansions[in.c];
+                        auto frame = expand(e, nodes[in.a], site, next);
+                        if (frame) {
+                            call_into(frame, next, in.b);
+                        } else {
+                            pc = in.b;
+                        }
+                        break;
+                    }
+                    default:
+                        stack.back() =
+                            lval::error(lerr::sexpr_not_function(f->type));
+                        lval::release(f);
+                        pc = in.b;
+                        break;
+                }
+                break;
+            }
+
+            case opcode::call: {
+                chunk *next;
+                auto frame = enter(e, in.a, next);
+                if (frame) call_into(frame, next, pc);
+                break;
+            }
+
+            case opcode::tail_call: {
+                chunk *next;
+                auto frame = enter(e, in.a, next);
+                if (frame && !exhausted(frame, next)) {
+                    release(current);
+                    current = next;
+                    pc = 0;
+                    push_frame(frame, base, outer);
+                    e = frame;
+                }
+                break;
+            }
+
+            case opcode::branch:
+                pc = branch(e, in, nodes[in.a], pc);
+                break;
+
+            case opcode::jump:
+                pc = in.a;
+                break;
+
+            case opcode::load_arg:
+                stack.push_back(lval::copy(stack[stack.size() - 1 - in.a]));
+                break;
+
+            case opcode::inlined:
+                if (!inlines(current->constants[in.a], in.b)) pc = in.c;
+                break;
+
+            case opcode::eval_inlined:
+                if (!eval_inlined()) pc = in.a;
+                break;
+
+            case opcode::leave:
+                leave(in.a);
+                break;
+
+            case opcode::guard:
+                if (!still_holds(e, *current, in)) pc = in.c;
+                break;
+
+            case opcode::closure:
+                closure(e, in.a, current->children[in.b]);
+                break;
+
+            case opcode::arith:
+                arith(e, in.a);
+                break;
+
+            case opcode::control:
+                if (stack.back() == intrinsics[in.a]) {
+                    lval::release(stack.back());
+                    stack.pop_back();
+                } else {
+                    pc = in.b;
+                }
+                break;
+
+            case opcode::test:
+                pc = test(in, pc);
+                break;
+
+            case opcode::dispatch:
+                pc = dispatch(*current, in);
+                break;
+
+            case opcode::match:
+                pc = match(in, pc);
+                break;
+
+            case opcode::drop:
+                if (drop(in.a)) pc = in.b;
+                break;
+
+            case opcode::pop:
+                lval::release(stack.back());
+                stack.pop_back();
+                break;
+
+            case opcode::scope: {
+                auto frame = lenv::frame();
+                auto next = copy(current->children[in.a]);
+                if (!in.b) {
+                    call_into(frame, next, pc);
+                } else if (!exhausted(frame, next)) {
+                    release(current);
+                    current = next;
+                    pc = 0;
+                    push_frame(frame, base, outer);
+                    e = frame;
+                }
+                break;
+            }
+        }
+    }
+
+    auto result = stack.back();
+    stack.pop_back();
+    return result;
+}
+
+settings &config() { return local_config; }
+
+} // namespace vm
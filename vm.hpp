@@ -0,0 +1,226 @@
+#ifndef LISPY_VM_HPP
+#define LISPY_VM_HPP
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+#include "atom.hpp"
+
+struct lval;
+struct lenv;
+
+// Bytecode for the bodies of lambdas. A body is compiled when the lambda is
+// made and run on a small stack machine from then on, instead of walking
+// (and copying) the expression tree on every call. Lambdas written inside a
+// body are compiled with it, so the ones it creates come ready to run.
+//
+// Calls to pure builtins on literals and on global data are worked out when
+// compiling, and so is the branch an if takes on such a condition. The
+// result is guarded by the globals it was found with, since any of them may
+// be rebound, or shadowed by a caller, by the time it runs.
+//
+// Calls to small global functions that only combine their arguments with
+// pure builtins, like not, eq or fst, have the body of the function compiled
+// in their place. The arguments stay on the stack and no frame is made,
+// unless eval needs one. The inlined code only runs while the symbol still
+// names that same function, so redefining it with def sends the call site
+// back to a regular call.
+//
+// The control builtins (do, let, select, case, and and or) are compiled in
+// place too, so only the expressions they pick are evaluated and the last
+// one runs in tail position. A case whose keys are all number or string
+// literals jumps straight to the clause matching the key through a hash
+// table, instead of comparing it with every key in turn.
+//
+// Calls to lambdas do not nest natively either. The machine saves the state
+// of the caller on a stack of its own, on the heap, so recursion is only
+// bounded by the memory that stack is allowed, see settings.
+//
+// Calls in tail position, including those made through if, eval and so
+// unpack, do not even take a place on that stack: the call goes on with the
+// code of the callee, so a loop written as tail recursion runs in constant
+// memory.
+//
+// The machine evaluates exactly like lval::eval_sexpr: lookups go through
+// the frames of the call as usual, scoping stays dynamic and every call ends
+// up in lval::call or a builtin. The few builtins with an opcode of their
+// own (if, the control builtins, lambda creation and integer arithmetic) are
+// only taken when the symbol still names the original builtin at run time,
+// otherwise the instruction falls back to a regular call.
+namespace vm {
+
+enum class opcode : unsigned char {
+    // Pushes node a
+    push,
+    // Pushes constant a
+    constant,
+    // Pushes a new empty S-expression
+    empty,
+    // Pushes the value bound to symbol node a, or an error if unbound. The
+    // local flavour is for symbols resolved to a parameter, see lval.hpp
+    load_local,
+    load_global,
+    // Pushes the value a places below the top, an argument of an inlined
+    // call
+    load_arg,
+    // Evaluates the value on top as the only cell of an S-expression
+    single,
+    // Checks the callee on top before the arguments of S-expression node a
+    // are evaluated. Anything but a function is dealt with here and leaves
+    // the result in its place, jumping to b. Macros expand through slot c
+    // of the expansions
+    head,
+    // Calls the function below the a arguments on top
+    call,
+    // Same as call, when nothing is left to do afterwards
+    tail_call,
+    // if with literal branches, node a. Pops the condition and jumps to b
+    // when it is false, or leaves the result and jumps to c on anything
+    // else than the original builtin and a boolean
+    branch,
+    jump,
+    // Goes on if the symbols of assumptions a to a + b still name the values
+    // the code that follows was folded with, otherwise jumps to c
+    guard,
+    // Goes on with the inlined body of function constant a if that is what
+    // is below the b arguments on top and none of them is an error,
+    // otherwise jumps to c
+    inlined,
+    // Evaluates the Q-Expression on top like eval, in an inlined body. If
+    // that needs the frame of the call, pops it and jumps to a, where the
+    // call is made after all
+    eval_inlined,
+    // Replaces the inlined call with its result, on top of its a arguments
+    leave,
+    // Lambda or macro with literal formals and body, compiled to child b.
+    // a tells which builtin makes it
+    closure,
+    // Builtin a applied to the two arguments on top
+    arith,
+    // Goes on with the code compiled for control builtin a if that is the
+    // callee on top, popping it. Otherwise jumps to b, where the call is made
+    // as usual
+    control,
+    // Pops the condition on top and jumps to a when it is false. Anything
+    // but a boolean leaves an error as the result of control builtin c in
+    // its place and jumps to b
+    test,
+    // Jumps to the clause of case table a matching the key on top, or to b
+    // if there is none. An error is left as the result, jumping to c
+    dispatch,
+    // Pops the value on top and jumps to a unless it equals the key below.
+    // An error takes the place of the key as the result, jumping to b
+    match,
+    // Drops the a values on top. If any of them is an error, the first one
+    // is left instead, jumping to b
+    drop,
+    // Drops the value on top
+    pop,
+    // Runs child a in a new frame, like the body of a lambda called without
+    // arguments. b is set when nothing is left to do afterwards
+    scope
+};
+
+struct instruction {
+    opcode op;
+    unsigned a;
+    unsigned b;
+    unsigned c;
+};
+
+// Result of the last macro called at a call site. Macros whose body only
+// combines their arguments with data and pure builtins give the same result
+// every time, so it is reused until one of those globals changes or
+// another macro is called there
+struct expansion {
+    // Both retained, or null
+    lval *macro;
+    lval *result;
+    // Global version the result was found at, see lenv::version
+    unsigned version;
+};
+
+enum class purity : unsigned char { unknown, pure, impure };
+
+// Global value of symbol node a taken for granted by folded code
+struct assumption {
+    unsigned node;
+    // Retained
+    const lval *value;
+};
+
+// Clause of a case to jump to for a key
+struct case_target {
+    // Node of the key
+    unsigned key;
+    unsigned target;
+};
+
+// Clauses of a case by the hash of their key, see memo::hash. When keys are
+// repeated only the first clause is there
+using jump_table = std::unordered_multimap<size_t, case_target>;
+
+struct chunk {
+    std::vector<instruction> code;
+    // Nodes of the body the instructions refer to, each one retained
+    std::vector<lval *> nodes;
+    // Values of the expressions folded when compiling, each one retained
+    std::vector<lval *> constants;
+    std::vector<assumption> assumptions;
+    std::vector<jump_table> tables;
+    // Code of the lambdas it creates, compiled along with it
+    std::vector<chunk *> children;
+    // One per call site
+    std::vector<expansion> expansions;
+    // Whether running it as the body of a macro always gives the same
+    // result for the same arguments, see expansion. Worked out on first use
+    // and again once a global changes, see lenv::version
+    purity body_purity = purity::unknown;
+    unsigned purity_version = 0;
+    // Globals it then depends on
+    std::vector<atom> globals;
+    mutable unsigned refs = 1;
+
+    chunk() = default;
+    chunk(const chunk &other) = delete;
+    ~chunk();
+};
+
+struct settings {
+    // Bytes the evaluation stacks may take. Calls past it fail
+    size_t max_stack;
+};
+
+// Compiles body the way lval::eval_qexpr evaluates it
+chunk *compile(const lval *body);
+
+// Both accept null
+chunk *copy(const chunk *c);
+void release(chunk *c);
+
+// Evaluates a compiled body in the frame e, which it takes over, returning
+// the result
+lval *run(lenv *e, const chunk *c);
+
+settings &config();
+
+// Whether evaluation nested so deep through builtins like eval, which the
+// machine cannot run in its loop, that the native stack is about to run out
+bool native_stack_exhausted();
+
+// Adds the values c holds on to, beyond the nodes of its body, to values.
+// The collector has to see them too
+void trace(const chunk *c, std::vector<lval *> &values);
+
+// Evaluates v, a call to f with two operands, the way compiled code does
+// when f is the prelude and or or: the second operand only when the first
+// one does not settle the result. Returns null for any other call
+lval *short_circuit(lenv *e, const lval *f, const lval *v);
+
+// Records the builtins in e the machine treats specially. Called once they
+// are added, and again once the prelude has defined and and or
+void bind_intrinsics(const lenv *e);
+
+} // namespace vm
+
+#endif // LISPY_VM_HPP